@@ -0,0 +1,495 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <chrono>  // high_resolution_clock
+#include <random>  // std::mt19937
+using Clock = std::chrono::high_resolution_clock;
+#include "ObjModel.h"
+#include "CompressedMesh.h"
+#include "MappedFile.h"
+#include "Matrix.h"
+#include "Affine.h"
+#include "Transformation.h"
+#include "VertexTransform.h"
+#include "OffscreenBuffer.h"
+
+// Command line converter from obj files to compressed meshes.
+//
+// Usage: MeshConverter input.obj [output.mshz] [/maxerror pixels]
+//                      [/bench runs] [/cleanup] [/reorder]
+//        MeshConverter /benchmath runs
+//        MeshConverter /benchengines runs model.obj|directory ...
+//        MeshConverter /checkallocs runs model.obj|directory ...
+//
+// /benchmath times composing the view transform and transforming vertices
+// with Matrix4x4R and Vector4R against Affine3x4R and VertexTransform.
+//
+// /benchengines draws each model, or each obj file of each directory, from
+// runs angles with both ObjModel::RasterEngine values, e.g. ObjModels to
+// compare them on the whole corpus.
+//
+// /checkallocs draws each model runs times after a first frame with each
+// ObjModel::RasterEngine, turning, zooming and panning it, and fails if any
+// of these frames allocates memory.
+//
+// /cleanup runs ObjModel::CleanupMesh() and /reorder runs
+// ObjModel::ReorderForLocality() before saving. Reordering numbers the
+// vertices by first use, which also makes the index deltas smaller.
+//
+// The conversion is refused when quantization would move a vertex more than
+// maxerror pixels (default ObjModel::MAX_QUANTIZATION_ERROR) at the largest
+// zoom of the viewer, see ObjModel::GetMaxQuantizationError().
+
+static void PrintUsage()
+{
+    wprintf(L"Usage: MeshConverter input.obj [output%s] "
+            L"[/maxerror pixels] [/bench runs] [/cleanup] [/reorder]\n"
+            L"       MeshConverter /benchmath runs\n"
+            L"       MeshConverter /benchengines runs "
+            L"model.obj|directory ...\n"
+            L"       MeshConverter /checkallocs runs "
+            L"model.obj|directory ...\n",
+            CompressedMesh::EXTENSION);
+}
+
+// Every operator new of the program is counted for /checkallocs.
+static std::atomic<size_t> g_allocationCount{0};
+
+void *operator new(size_t size)
+{
+    ++g_allocationCount;
+    void *p = std::malloc(size != 0 ? size : 1);
+    if (!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+static double Milliseconds(Clock::time_point t1, Clock::time_point t2)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        t2 - t1).count() / 1000.0;
+}
+
+// Decode the file runs times and print the throughput.
+static void Benchmark(const std::wstring & filePath, int runs)
+{
+    CompressedMesh mesh;
+    if (!mesh.Open(filePath))
+    {
+        wprintf(L"Fail to open %s\n", filePath.c_str());
+        return;
+    }
+    const CompressedMesh::Header &header = mesh.GetHeader();
+
+    std::vector<REAL> vertices(header.vertexCount * 3);
+    std::vector<UINT32> faceSizes;
+    std::vector<UINT32> indices;
+    double vertexTime = 0;
+    double faceTime = 0;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto t1 = Clock::now();
+        mesh.DecodeVertices(vertices.data());
+        auto t2 = Clock::now();
+        mesh.DecodeFaces(faceSizes, indices);
+        auto t3 = Clock::now();
+        vertexTime += Milliseconds(t1, t2);
+        faceTime += Milliseconds(t2, t3);
+    }
+    vertexTime /= runs;
+    faceTime /= runs;
+
+    ObjModel model;
+    auto t1 = Clock::now();
+    for (int i = 0; i < runs; ++i)
+        model.LoadFromCompressedFile(filePath);
+    auto t2 = Clock::now();
+
+    wprintf(L"Vertices: %.3f ms, %.1f M vertices/s\n", vertexTime,
+            header.vertexCount / vertexTime / 1000);
+    wprintf(L"Faces:    %.3f ms, %.1f M indices/s\n", faceTime,
+            header.indexCount / faceTime / 1000);
+    wprintf(L"ObjModel::LoadFromCompressedFile: %.3f ms\n",
+            Milliseconds(t1, t2) / runs);
+}
+
+// Obj files named by paths, and the obj files in the directories among them.
+static std::vector<std::wstring> FindObjFiles(
+    const std::vector<std::wstring> & paths)
+{
+    std::vector<std::wstring> files;
+    for (const std::wstring &path : paths)
+    {
+        DWORD attributes = GetFileAttributesW(path.c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES ||
+            !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            files.push_back(path);
+            continue;
+        }
+        WIN32_FIND_DATAW data;
+        HANDLE find = FindFirstFileW((path + L"\\*.obj").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) { continue; }
+        do
+        {
+            files.push_back(path + L"\\" + data.cFileName);
+        } while (FindNextFileW(find, &data));
+        FindClose(find);
+    }
+    return files;
+}
+
+// Draw every model runs times from different angles with each
+// ObjModel::RasterEngine, check that both draw the same images and print
+// the time per frame, and the part of the span pixels the coarse depth of
+// DEPTH_BUFFER resolved without depth tests.
+static void BenchmarkEngines(const std::vector<std::wstring> & paths,
+                             int runs)
+{
+    const INT32 width = 1024;
+    const INT32 height = 768;
+    OffscreenBuffer depthImage, spanImage;
+    depthImage.Resize(width, height);
+    spanImage.Resize(width, height);
+
+    wprintf(L"%-24s %12s %10s %12s %10s  %s\n", L"Model", L"Depth ms",
+            L"Block %", L"Spans ms", L"Tested %", L"Images");
+    for (const std::wstring &file : FindObjFiles(paths))
+    {
+        ObjModel model;
+        model.SetMeshCacheEnabled(false);
+        model.LoadFromObjFile(file);
+
+        double depthTime = 0;
+        double spanTime = 0;
+        UINT64 blockPixels = 0;
+        UINT64 spanPixels = 0;
+        UINT64 pixels = 0;
+        UINT64 tested = 0;
+        bool same = true;
+        for (int i = 0; i < runs; ++i)
+        {
+            // Every frame is drawn from scratch, as the angle changes.
+            const REAL degreeX = 20.0f + 10.0f * (i % 5);
+            const REAL degreeY = 360.0f * i / runs;
+            model.SetRasterEngine(ObjModel::RasterEngine::DEPTH_BUFFER);
+            auto t1 = Clock::now();
+            model.GetBuffer(depthImage, 0.95f, degreeX, degreeY, 0, 0);
+            auto t2 = Clock::now();
+            const ObjModel::RasterStats &stats = model.GetRasterStats();
+            blockPixels += stats.pixelsSkipped + stats.pixelsFilled;
+            spanPixels += stats.pixelsSkipped + stats.pixelsFilled +
+                          stats.pixelsTested;
+            model.SetRasterEngine(ObjModel::RasterEngine::SPANS);
+            model.GetBuffer(spanImage, 0.95f, degreeX, degreeY, 0, 0);
+            auto t3 = Clock::now();
+            depthTime += Milliseconds(t1, t2);
+            spanTime += Milliseconds(t2, t3);
+            pixels += model.GetRasterStats().pixelsWritten;
+            tested += model.GetRasterStats().pixelsTested;
+            same = same && depthImage.IsSameImage(spanImage);
+        }
+
+        size_t slash = file.find_last_of(L"\\/");
+        wprintf(L"%-24s %12.3f %10.1f %12.3f %10.1f  %s\n",
+                file.substr(slash == std::wstring::npos ? 0 : slash + 1)
+                    .c_str(),
+                depthTime / runs,
+                100.0 * blockPixels / (spanPixels ? spanPixels : 1),
+                spanTime / runs,
+                100.0 * tested / (pixels ? pixels : 1),
+                same ? L"same" : L"DIFFERENT");
+    }
+    wprintf(L"Block %%: span pixels DEPTH_BUFFER skipped or filled a block "
+            L"at a time.\n"
+            L"Tested %%: depth tests of the span engine per pixel drawn.\n");
+}
+
+// Draw every model as in BenchmarkEngines(), after a first frame with each
+// ObjModel::RasterEngine, which sets up the tables and the scratch of the
+// model. Every third frame is zoomed in, so that only the faces in view are
+// transformed, and every frame is then panned a little. Print the
+// allocations of these frames and return whether there were none.
+static bool CheckAllocations(const std::vector<std::wstring> & paths,
+                             int runs)
+{
+    const INT32 width = 1024;
+    const INT32 height = 768;
+    OffscreenBuffer image;
+    image.Resize(width, height);
+
+    const ObjModel::RasterEngine engines[2] = {
+        ObjModel::RasterEngine::DEPTH_BUFFER, ObjModel::RasterEngine::SPANS};
+    wprintf(L"%-24s %14s %14s\n", L"Model", L"Depth allocs",
+            L"Spans allocs");
+    bool passed = true;
+    for (const std::wstring &file : FindObjFiles(paths))
+    {
+        ObjModel model;
+        model.SetMeshCacheEnabled(false);
+        model.LoadFromObjFile(file);
+
+        size_t allocations[2] = {0, 0};
+        for (int e = 0; e < 2; ++e)
+        {
+            model.SetRasterEngine(engines[e]);
+            model.GetBuffer(image, 0.95f, 20.0f, 0, 0, 0);
+            const size_t before = g_allocationCount;
+            for (int i = 0; i < runs; ++i)
+            {
+                const REAL scaleFactor = i % 3 == 2 ? 3.0f : 0.95f;
+                const REAL degreeX = 20.0f + 10.0f * (i % 5);
+                const REAL degreeY = 360.0f * i / runs;
+                model.GetBuffer(image, scaleFactor, degreeX, degreeY, 0, 0);
+                model.GetBuffer(image, scaleFactor, degreeX, degreeY, 7, -3);
+            }
+            allocations[e] = g_allocationCount - before;
+        }
+
+        size_t slash = file.find_last_of(L"\\/");
+        wprintf(L"%-24s %14zu %14zu\n",
+                file.substr(slash == std::wstring::npos ? 0 : slash + 1)
+                    .c_str(),
+                allocations[0], allocations[1]);
+        passed = passed && allocations[0] == 0 && allocations[1] == 0;
+    }
+    wprintf(passed ? L"No frame allocated.\n" :
+                     L"FAILED: frames allocated memory.\n");
+    return passed;
+}
+
+static Matrix4x4R ToMatrix(const Affine3x4R & affine)
+{
+    REAL t[4][4] = {{affine.m[0][0], affine.m[0][1], affine.m[0][2],
+                     affine.m[0][3]},
+                    {affine.m[1][0], affine.m[1][1], affine.m[1][2],
+                     affine.m[1][3]},
+                    {affine.m[2][0], affine.m[2][1], affine.m[2][2],
+                     affine.m[2][3]},
+                    {0, 0, 0, 1}};
+    return t;
+}
+
+// Time the view transform of ObjModel::TransformModel() built from
+// Matrix4x4R and applied with Vector4R, as it used to be, against
+// Affine3x4R and VertexTransform.
+static void BenchmarkMath(int runs)
+{
+    const Affine3x4R factors[6] = {
+        Transformation::Translate(400, 300, 0),
+        Transformation::Scale(250),
+        Transformation::RotateAboutXAxis(30),
+        Transformation::RotateAboutYAxis(45),
+        Transformation::Symmetry(true, false, true),
+        Transformation::Translate(-0.1f, -0.2f, -0.3f)};
+    Matrix4x4R matrices[6];
+    for (int i = 0; i < 6; ++i)
+        matrices[i] = ToMatrix(factors[i]);
+
+    // The factors are rotated every iteration so that the product cannot
+    // be hoisted out of the loop, and the sums keep it from being dropped.
+    const int composeCount = 1 << 20;
+    REAL matrixSum = 0;
+    REAL affineSum = 0;
+    auto t1 = Clock::now();
+    for (int i = 0; i < composeCount; ++i)
+    {
+        const int k = i % 6;
+        Matrix4x4R m = matrices[k] * matrices[(k + 1) % 6] *
+                       matrices[(k + 2) % 6] * matrices[(k + 3) % 6] *
+                       matrices[(k + 4) % 6] * matrices[(k + 5) % 6];
+        Vector4R p = m * Vector4R{1, 1, 1, 1};
+        matrixSum += p.x + p.y + p.z;
+    }
+    auto t2 = Clock::now();
+    for (int i = 0; i < composeCount; ++i)
+    {
+        const int k = i % 6;
+        Affine3x4R m = factors[k] * factors[(k + 1) % 6] *
+                       factors[(k + 2) % 6] * factors[(k + 3) % 6] *
+                       factors[(k + 4) % 6] * factors[(k + 5) % 6];
+        Position3R p = m * Position3R{1, 1, 1};
+        affineSum += p.x + p.y + p.z;
+    }
+    auto t3 = Clock::now();
+    volatile REAL sink = matrixSum + affineSum;
+    (void)sink;
+    wprintf(L"Compose 6 transforms: Matrix4x4R %.1f ns, "
+            L"Affine3x4R %.1f ns\n",
+            Milliseconds(t1, t2) * 1e6 / composeCount,
+            Milliseconds(t2, t3) * 1e6 / composeCount);
+
+    const size_t vertexCount = 1 << 20;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<REAL> coordinate(-1, 1);
+    std::vector<REAL> x(vertexCount), y(vertexCount), z(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        x[i] = coordinate(random);
+        y[i] = coordinate(random);
+        z[i] = coordinate(random);
+    }
+    const Matrix4x4R matrix = matrices[0] * matrices[1] * matrices[2] *
+                              matrices[3] * matrices[4] * matrices[5];
+    const Affine3x4R affine = factors[0] * factors[1] * factors[2] *
+                              factors[3] * factors[4] * factors[5];
+    std::vector<Position3R> out;
+    out.reserve(vertexCount);
+    double matrixTime = 0;
+    double affineTime = 0;
+    double batchTime = 0;
+    for (int run = 0; run < runs; ++run)
+    {
+        out.clear();
+        auto t1 = Clock::now();
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            Vector4R p = matrix * Vector4R{x[i], y[i], z[i], 1};
+            out.push_back({p.x, p.y, p.z});
+        }
+        auto t2 = Clock::now();
+        for (size_t i = 0; i < vertexCount; ++i)
+            out[i] = affine * Position3R{x[i], y[i], z[i]};
+        auto t3 = Clock::now();
+        VertexTransform::Transform(affine, x.data(), y.data(), z.data(),
+                                   vertexCount, out.data());
+        auto t4 = Clock::now();
+        matrixTime += Milliseconds(t1, t2);
+        affineTime += Milliseconds(t2, t3);
+        batchTime += Milliseconds(t3, t4);
+    }
+    wprintf(L"Transform vertices: Matrix4x4R * Vector4R %.1f M/s, "
+            L"Affine3x4R * Position3R %.1f M/s, "
+            L"VertexTransform (%s) %.1f M/s\n",
+            vertexCount * runs / matrixTime / 1000,
+            vertexCount * runs / affineTime / 1000,
+            VertexTransform::IsAvxUsed() ? L"AVX" : L"SSE",
+            vertexCount * runs / batchTime / 1000);
+}
+
+int wmain(int argc, wchar_t *argv[])
+{
+    std::wstring input;
+    std::wstring output;
+    double maxError = ObjModel::MAX_QUANTIZATION_ERROR;
+    int runs = 0;
+    int mathRuns = 0;
+    int engineRuns = 0;
+    int allocationRuns = 0;
+    std::vector<std::wstring> models;
+    bool cleanup = false;
+    bool reorder = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"/maxerror") == 0 && i + 1 < argc)
+            maxError = _wtof(argv[++i]);
+        else if (_wcsicmp(argv[i], L"/bench") == 0 && i + 1 < argc)
+            runs = _wtoi(argv[++i]);
+        else if (_wcsicmp(argv[i], L"/benchmath") == 0 && i + 1 < argc)
+            mathRuns = _wtoi(argv[++i]);
+        else if (_wcsicmp(argv[i], L"/benchengines") == 0 && i + 1 < argc)
+            engineRuns = _wtoi(argv[++i]);
+        else if (_wcsicmp(argv[i], L"/checkallocs") == 0 && i + 1 < argc)
+            allocationRuns = _wtoi(argv[++i]);
+        else if (_wcsicmp(argv[i], L"/cleanup") == 0)
+            cleanup = true;
+        else if (_wcsicmp(argv[i], L"/reorder") == 0)
+            reorder = true;
+        else
+            models.push_back(argv[i]);
+    }
+    if (engineRuns > 0 && !models.empty())
+    {
+        BenchmarkEngines(models, engineRuns);
+        return 0;
+    }
+    if (allocationRuns > 0 && !models.empty())
+    {
+        return CheckAllocations(models, allocationRuns) ? 0 : 1;
+    }
+    if (models.size() > 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+    if (models.size() > 0) { input = models[0]; }
+    if (models.size() > 1) { output = models[1]; }
+    if (input.empty() && mathRuns > 0)
+    {
+        BenchmarkMath(mathRuns);
+        return 0;
+    }
+    if (input.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+    if (output.empty())
+    {
+        size_t dot = input.find_last_of(L'.');
+        output = input.substr(0, dot) + CompressedMesh::EXTENSION;
+    }
+
+    ObjModel model;
+    model.SetMeshCacheEnabled(false);
+    auto t1 = Clock::now();
+    model.LoadFromObjFile(input);
+    auto t2 = Clock::now();
+    wprintf(L"Parsed %s in %.3f ms\n", input.c_str(), Milliseconds(t1, t2));
+
+    if (cleanup)
+    {
+        ObjModel::CleanupStats stats = model.CleanupMesh();
+        wprintf(L"Cleanup: %u vertices welded, %u unused vertices, "
+                L"%u degenerate faces, %u duplicate faces\n",
+                stats.weldedVertices, stats.unusedVertices,
+                stats.degenerateFaces, stats.duplicateFaces);
+    }
+    if (reorder)
+    {
+        model.ReorderForLocality();
+    }
+
+    double error = model.GetMaxQuantizationError(
+        ObjModel::MAX_SCALE_FACTOR, ObjModel::MAX_ERROR_WIDTH,
+        ObjModel::MAX_ERROR_HEIGHT);
+    wprintf(L"Quantization error at zoom %.0f in %dx%d: %.3f pixels "
+            L"(limit %.3f)\n", ObjModel::MAX_SCALE_FACTOR,
+            ObjModel::MAX_ERROR_WIDTH, ObjModel::MAX_ERROR_HEIGHT,
+            error, maxError);
+    if (error > maxError)
+    {
+        wprintf(L"Refused: quantization error exceeds the limit.\n");
+        return 2;
+    }
+
+    if (!model.SaveCompressedFile(output))
+    {
+        wprintf(L"Fail to write %s\n", output.c_str());
+        return 1;
+    }
+
+    MappedFile in, out;
+    in.Open(input);
+    out.Open(output);
+    wprintf(L"Wrote %s: %zu -> %zu bytes (%.1f%%)\n", output.c_str(),
+            in.GetSize(), out.GetSize(),
+            100.0 * out.GetSize() / (in.GetSize() ? in.GetSize() : 1));
+
+    if (runs > 0) { Benchmark(output, runs); }
+    return 0;
+}
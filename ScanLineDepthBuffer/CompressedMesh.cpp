@@ -0,0 +1,224 @@
+#include <cmath>  // std::sqrt() std::lround()
+#include <cstring>  // std::memcmp() std::memcpy()
+#include "CompressedMesh.h"
+#include "FileWriter.h"
+#include "DebugPrint.h"
+
+static const char MAGIC[8] = {'S', 'L', 'D', 'B', 'M', 'S', 'H', 'Z'};
+
+const wchar_t * const CompressedMesh::EXTENSION = L".mshz";
+
+double CompressedMesh::GetMaxScreenError(const double box[6],
+                                         double scaleFactor,
+                                         INT32 width, INT32 height)
+{
+    double xExtent = box[1] - box[0];
+    double yExtent = box[3] - box[2];
+    double zExtent = box[5] - box[4];
+    double xScale = width / xExtent;
+    double yScale = height / yExtent;
+    double scale = (xScale < yScale ? xScale : yScale) * scaleFactor;
+
+    double dx = xExtent / QUANTIZATION_LEVELS;
+    double dy = yExtent / QUANTIZATION_LEVELS;
+    double dz = zExtent / QUANTIZATION_LEVELS;
+    return scale * std::sqrt(dx * dx + dy * dy + dz * dz) / 2;
+}
+
+static UINT32 ZigZag(INT32 n)
+{
+    return (static_cast<UINT32>(n) << 1) ^ static_cast<UINT32>(n >> 31);
+}
+
+static INT32 UnZigZag(UINT32 n)
+{
+    return static_cast<INT32>(n >> 1) ^ -static_cast<INT32>(n & 1);
+}
+
+bool CompressedMesh::Write(const std::wstring & filePath, const double box[6],
+                           const std::vector<REAL> & vertices,
+                           const std::vector<UINT32> & faceSizes,
+                           const std::vector<UINT32> & indices)
+{
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertexCount = static_cast<UINT32>(vertices.size() / 3);
+    header.faceCount = static_cast<UINT32>(faceSizes.size());
+    header.indexCount = static_cast<UINT32>(indices.size());
+    header.valueCount = header.faceCount + header.indexCount;
+    std::memcpy(header.box, box, sizeof(header.box));
+
+    // Quantize positions, axis by axis.
+    std::vector<UINT16> positions[3];
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double lower = box[axis * 2];
+        double extent = box[axis * 2 + 1] - lower;
+        double factor = extent > 0 ? QUANTIZATION_LEVELS / extent : 0;
+        positions[axis].resize(header.vertexCount);
+        for (UINT32 i = 0; i != header.vertexCount; ++i)
+        {
+            long q = std::lround((vertices[i * 3 + axis] - lower) * factor);
+            if (q < 0) q = 0;
+            if (q > static_cast<long>(QUANTIZATION_LEVELS))
+                q = QUANTIZATION_LEVELS;
+            positions[axis][i] = static_cast<UINT16>(q);
+        }
+    }
+
+    // Pack the face stream.
+    std::vector<UINT8> control((header.valueCount + 3) / 4, 0);
+    std::vector<UINT8> data;
+    data.reserve(header.valueCount * 2);
+    UINT32 valueId = 0;
+    auto put = [&](UINT32 value)
+    {
+        UINT32 bytes = value < (1u << 8) ? 1 : value < (1u << 16) ? 2 :
+                       value < (1u << 24) ? 3 : 4;
+        control[valueId / 4] |= static_cast<UINT8>((bytes - 1) <<
+                                                   (valueId % 4 * 2));
+        for (UINT32 b = 0; b != bytes; ++b)
+            data.push_back(static_cast<UINT8>(value >> (b * 8)));
+        ++valueId;
+    };
+
+    UINT32 previous = 0;
+    size_t next = 0;
+    for (UINT32 size : faceSizes)
+    {
+        if (size < 3 || next + size > indices.size())
+        {
+            DebugPrint(L"[ERR] CompressedMesh::Write : Invalid face.");
+            return false;
+        }
+        put(size - 3);
+        for (UINT32 k = 0; k != size; ++k)
+        {
+            UINT32 index = indices[next++];
+            put(ZigZag(static_cast<INT32>(index - previous)));
+            previous = index;
+        }
+    }
+    header.dataSize = data.size();
+    // Spare bytes, so the decoder may always load 4 bytes at once.
+    data.resize(data.size() + 4, 0);
+
+    FileWriter writer;
+    return writer.Open(filePath) &&
+        writer.WriteAligned(&header, sizeof(header)) &&
+        writer.WriteAligned(positions[0].data(),
+                            header.vertexCount * sizeof(UINT16)) &&
+        writer.WriteAligned(positions[1].data(),
+                            header.vertexCount * sizeof(UINT16)) &&
+        writer.WriteAligned(positions[2].data(),
+                            header.vertexCount * sizeof(UINT16)) &&
+        writer.WriteAligned(control.data(), control.size()) &&
+        writer.WriteAligned(data.data(), data.size()) &&
+        writer.Commit();
+}
+
+bool CompressedMesh::Open(const std::wstring & filePath)
+{
+    if (!m_file.Open(filePath)) { return false; }
+
+    if (m_file.GetSize() < sizeof(Header))
+    {
+        m_file.Close();
+        return false;
+    }
+    const Header &header = GetHeader();
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.valueCount != header.faceCount + header.indexCount)
+    {
+        m_file.Close();
+        return false;
+    }
+
+    size_t pos = Align8(sizeof(Header));
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        m_positionPos[axis] = pos;
+        pos = Align8(pos + header.vertexCount * sizeof(UINT16));
+    }
+    m_controlPos = pos;
+    m_dataPos = Align8(pos + (header.valueCount + 3ull) / 4);
+    if (Align8(m_dataPos + header.dataSize + 4) != m_file.GetSize())
+    {
+        DebugPrint(L"[WRN] CompressedMesh::Open : Damaged file: %s",
+                   filePath.c_str());
+        m_file.Close();
+        return false;
+    }
+    return true;
+}
+
+void CompressedMesh::DecodeVertices(REAL * vertices) const
+{
+    const Header &header = GetHeader();
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        const UINT16 *q = reinterpret_cast<const UINT16 *>(
+            m_file.GetData() + m_positionPos[axis]);
+        REAL lower = static_cast<REAL>(header.box[axis * 2]);
+        REAL step = static_cast<REAL>(
+            (header.box[axis * 2 + 1] - header.box[axis * 2]) /
+            QUANTIZATION_LEVELS);
+        REAL *out = vertices + axis;
+        for (UINT32 i = 0; i != header.vertexCount; ++i)
+            out[i * 3] = lower + q[i] * step;
+    }
+}
+
+bool CompressedMesh::DecodeFaces(std::vector<UINT32> & faceSizes,
+                                 std::vector<UINT32> & indices) const
+{
+    static const UINT32 MASKS[4] = {0xff, 0xffff, 0xffffff, 0xffffffff};
+
+    const Header &header = GetHeader();
+    const UINT8 *control = reinterpret_cast<const UINT8 *>(
+        m_file.GetData() + m_controlPos);
+    const UINT8 *data = reinterpret_cast<const UINT8 *>(
+        m_file.GetData() + m_dataPos);
+    const UINT8 *dataEnd = data + header.dataSize;
+
+    faceSizes.resize(header.faceCount);
+    indices.resize(header.indexCount);
+
+    // Values are decoded in groups of four sharing one control byte.
+    UINT32 valueId = 0;
+    UINT32 codes = 0;
+    auto get = [&]() -> UINT32
+    {
+        if (valueId % 4 == 0) codes = control[valueId / 4];
+        ++valueId;
+        UINT32 code = codes & 3;
+        codes >>= 2;
+        UINT32 value;
+        std::memcpy(&value, data, 4);  // little-endian
+        data += code + 1;
+        return value & MASKS[code];
+    };
+
+    UINT32 previous = 0;
+    UINT32 next = 0;
+    for (UINT32 f = 0; f != header.faceCount; ++f)
+    {
+        UINT32 size = get() + 3;
+        if (size < 3 || size > header.indexCount - next) { return false; }
+        faceSizes[f] = size;
+        for (UINT32 k = 0; k != size; ++k)
+        {
+            previous += static_cast<UINT32>(UnZigZag(get()));
+            if (previous == 0 || previous > header.vertexCount ||
+                data > dataEnd)
+            {
+                return false;
+            }
+            indices[next++] = previous;
+        }
+    }
+    return next == header.indexCount && data == dataEnd;
+}
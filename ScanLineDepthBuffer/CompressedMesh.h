@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "MappedFile.h"
+
+/*
+ * Compressed mesh container, about a quarter of the size of the obj text.
+ *
+ * Positions are quantized to 16 bits per axis relative to the bounding box.
+ * Faces are stored as one stream of unsigned integers: for each face its
+ * vertex count minus 3, followed by the zigzag encoded difference of every
+ * vertex index to the previous one. The stream is packed with the Stream
+ * VByte layout (one 2-bit length code per value in a control stream, value
+ * bytes in a separate data stream), which decodes without data dependent
+ * branches and maps directly onto a byte shuffle when vectorized.
+ *
+ * Only geometric vertices and the vertex indices of faces are stored.
+ *
+ * File Layout (every part padded to 8 bytes):
+ *
+ *     Header
+ *     UINT16 x[vertexCount]
+ *     UINT16 y[vertexCount]
+ *     UINT16 z[vertexCount]
+ *     UINT8  control[(valueCount + 3) / 4]
+ *     UINT8  data[dataSize]               followed by at least 3 zero bytes
+ */
+class CompressedMesh
+{
+public:
+    static constexpr UINT32 VERSION = 1;
+    static constexpr UINT32 QUANTIZATION_LEVELS = 65535;
+
+    // File name extension of compressed meshes, including the dot.
+    static const wchar_t * const EXTENSION;
+
+    struct Header
+    {
+        char magic[8];
+        UINT32 version;
+        UINT32 vertexCount;
+        UINT32 faceCount;
+        UINT32 indexCount;  // sum of vertex counts of all faces
+        UINT32 valueCount;  // faceCount + indexCount
+        UINT32 reserved;
+        unsigned long long dataSize;
+        double box[6];  // xmin xmax ymin ymax zmin zmax
+    };
+
+    // Upper bound of the distance in pixels between a vertex and its
+    // quantized position when the model is drawn at scaleFactor into a
+    // width * height buffer, as ObjModel fits the box into the buffer.
+    //
+    // Rotations keep lengths and the projection drops z, so the bound is the
+    // model to screen scale times half the diagonal of a quantization cell.
+    static double GetMaxScreenError(const double box[6], double scaleFactor,
+                                    INT32 width, INT32 height);
+
+    // vertices: x y z of every vertex, vertex #1 comes first
+    // faceSizes: number of vertices of every face (at least 3)
+    // indices: 1-based vertex indices of all faces, one after another
+    static bool Write(const std::wstring & filePath, const double box[6],
+                      const std::vector<REAL> & vertices,
+                      const std::vector<UINT32> & faceSizes,
+                      const std::vector<UINT32> & indices);
+
+    // Map filePath and check its header. Return false if it is not a valid
+    // compressed mesh.
+    bool Open(const std::wstring & filePath);
+
+    const Header & GetHeader() const
+    {
+        return *reinterpret_cast<const Header *>(m_file.GetData());
+    }
+
+    // Dequantize all positions into vertices (x y z of every vertex), which
+    // must have room for 3 * vertexCount values.
+    void DecodeVertices(REAL * vertices) const;
+
+    // Decode the face stream. Return false if an index is out of range.
+    bool DecodeFaces(std::vector<UINT32> & faceSizes,
+                     std::vector<UINT32> & indices) const;
+
+private:
+    MappedFile m_file;
+    size_t m_positionPos[3];
+    size_t m_controlPos{0};
+    size_t m_dataPos{0};
+
+    static size_t Align8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+};
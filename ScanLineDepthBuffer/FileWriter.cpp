@@ -0,0 +1,74 @@
+#include "FileWriter.h"
+#include "DebugPrint.h"
+
+bool FileWriter::Open(const std::wstring & filePath)
+{
+    Discard();
+
+    m_filePath = filePath;
+    m_tempPath = filePath + L".tmp";
+    m_file = CreateFileW(m_tempPath.c_str(), GENERIC_WRITE, 0, NULL,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        DebugPrint(L"[WRN] FileWriter::Open : Fail to create file: %s",
+                   m_tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FileWriter::WriteAligned(const void * data, size_t size)
+{
+    if (m_file == INVALID_HANDLE_VALUE) { return false; }
+
+    const char *p = static_cast<const char *>(data);
+    size_t left = size;
+    while (left != 0)
+    {
+        DWORD toWrite = left > (1u << 30) ? (1u << 30) :
+            static_cast<DWORD>(left);
+        DWORD written = 0;
+        if (!WriteFile(m_file, p, toWrite, &written, NULL) ||
+            written != toWrite)
+        {
+            return false;
+        }
+        p += written;
+        left -= written;
+    }
+
+    static const char zeros[8] = { };
+    DWORD padding = static_cast<DWORD>((8 - size % 8) % 8);
+    DWORD written = 0;
+    return padding == 0 ||
+        WriteFile(m_file, zeros, padding, &written, NULL) &&
+        written == padding;
+}
+
+bool FileWriter::Commit()
+{
+    if (m_file == INVALID_HANDLE_VALUE) { return false; }
+
+    CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+    if (!MoveFileExW(m_tempPath.c_str(), m_filePath.c_str(),
+                     MOVEFILE_REPLACE_EXISTING))
+    {
+        DebugPrint(L"[WRN] FileWriter::Commit : Fail to write file: %s",
+                   m_filePath.c_str());
+        DeleteFileW(m_tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void FileWriter::Discard()
+{
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+        DeleteFileW(m_tempPath.c_str());
+    }
+}
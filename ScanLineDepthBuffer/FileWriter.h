@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <Windows.h>
+
+/*
+ * Writes a binary file through a temporary file, which replaces the target
+ * only in Commit(), so a half written file is never seen by readers.
+ */
+class FileWriter
+{
+public:
+    FileWriter() = default;
+    ~FileWriter() { Discard(); }
+
+    FileWriter(const FileWriter &) = delete;
+    FileWriter & operator=(const FileWriter &) = delete;
+
+    bool Open(const std::wstring & filePath);
+
+    // Write size bytes, then pad the file with zeros to a multiple of 8 so
+    // that the next part starts aligned.
+    bool WriteAligned(const void * data, size_t size);
+
+    // Replace the target file with what has been written.
+    bool Commit();
+
+    // Close and delete the temporary file, leaving the target untouched.
+    void Discard();
+
+private:
+    HANDLE m_file{INVALID_HANDLE_VALUE};
+    std::wstring m_filePath;
+    std::wstring m_tempPath;
+};
@@ -1,10 +1,13 @@
 ﻿#include <string>
+#include <memory>  // std::shared_ptr
+#include <mutex>
 #include <Windows.h>
 #include <shobjidl.h>
 #include <chrono>  // high_resolution_clock
 using Clock = std::chrono::high_resolution_clock;
 #include "MainWindow.h"
 #include "DebugPrint.h"
+#include "CompressedMesh.h"
 
 LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
@@ -21,6 +24,8 @@ LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
     static REAL shiftY = 0.0f;
     constexpr REAL shiftStep = 10.0f;
 
+    static bool backFaceCulling = false;
+
     switch (uMsg)
     {
     //case WM_CLOSE:
@@ -51,7 +56,10 @@ LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
             case L'z': case L'Z':
                 // Zoom in
                 {
-                    if (scaleFactor < 50.0f) { scaleFactor += scaleFactorStep; }
+                    if (scaleFactor < ObjModel::MAX_SCALE_FACTOR)
+                    {
+                        scaleFactor += scaleFactorStep;
+                    }
                     InvalidateRect(m_hwnd, NULL, FALSE);
                 }
                 break;
@@ -122,6 +130,20 @@ LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
                     InvalidateRect(m_hwnd, NULL, FALSE);
                 }
                 break;
+            case L'b': case L'B':
+                // Toggle back-face culling, only right for closed models.
+                {
+                    backFaceCulling = !backFaceCulling;
+                    InvalidateRect(m_hwnd, NULL, FALSE);
+                }
+                break;
+            case L'm': case L'M':
+                // Toggle the mesh cleanup of the models opened next.
+                {
+                    m_cleanupMesh = !m_cleanupMesh;
+                    InvalidateRect(m_hwnd, NULL, FALSE);
+                }
+                break;
             }
         }
         return DefWindowProc(m_hwnd, uMsg, wParam, lParam);
@@ -166,8 +188,20 @@ LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
 
             //m_buffer.DebugDarwRandomPicture();
 
+            // The model may be replaced by the loader thread at any time.
+            std::shared_ptr<ObjModel> model;
+            {
+                std::lock_guard<std::mutex> lock(m_modelMutex);
+                model = m_objModel;
+            }
+
             auto t1 = Clock::now();
-            m_objModel.GetBuffer(buffer, scaleFactor, degreeX, degreeY, shiftX, shiftY);
+            if (model)
+            {
+                model->SetBackFaceCulling(backFaceCulling);
+                model->GetBuffer(buffer, scaleFactor, degreeX, degreeY,
+                                 shiftX, shiftY);
+            }
             auto t2 = Clock::now();
             REAL deltaT = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0f;
 
@@ -183,12 +217,35 @@ LRESULT MainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
             SetTextColor(hdc, Color::WHITE.GetColorCode());
             SetBkMode(hdc, TRANSPARENT);
             constexpr WCHAR *description = L"W A S D: move\nI J K L: rotate\n"
-                                           L"Z C: zoom\nX: reset";
+                                           L"Z C: zoom\nX: reset\n"
+                                           L"B: back-face culling\n"
+                                           L"M: mesh cleanup on open";
             DrawText(hdc, description, -1, &rc, DT_TOP | DT_LEFT | DT_NOCLIP);
 
             constexpr UINT32 MAX_CHARS = 100;
             WCHAR strbuf[MAX_CHARS];
             swprintf(strbuf, MAX_CHARS, L"%.3f ms\n%.3f fps", deltaT, 1000.0f / deltaT);
+            if (m_cleanupMesh)
+            {
+                size_t length = wcslen(strbuf);
+                swprintf(strbuf + length, MAX_CHARS - length,
+                         L"\ncleanup on open");
+            }
+            if (backFaceCulling && model)
+            {
+                size_t length = wcslen(strbuf);
+                swprintf(strbuf + length, MAX_CHARS - length, L"\n%u culled",
+                         model->GetCulledFaceCount());
+            }
+            if (model && model->GetRasterStats().pixelsWritten != 0)
+            {
+                const auto &stats = model->GetRasterStats();
+                size_t length = wcslen(strbuf);
+                swprintf(strbuf + length, MAX_CHARS - length,
+                         L"\n%.2f overdraw",
+                         static_cast<double>(stats.pixelsTested) /
+                         stats.pixelsWritten);
+            }
             DrawText(hdc, strbuf, -1, &rc, DT_TOP | DT_RIGHT | DT_NOCLIP);
 
             EndPaint(m_hwnd, &ps);
@@ -211,8 +268,10 @@ void MainWindow::OpenObjFile()
 
         if (SUCCEEDED(hr))
         {
-            COMDLG_FILTERSPEC filter = {L"Obj files (*.obj)", L"*.obj"};
-            pFileOpen->SetFileTypes(1, &filter);
+            COMDLG_FILTERSPEC filters[] = {
+                {L"Obj files (*.obj)", L"*.obj"},
+                {L"Compressed meshes (*.mshz)", L"*.mshz"}};
+            pFileOpen->SetFileTypes(2, filters);
 
             pFileOpen->SetTitle(L"请选择要打开的 obj 文件");
 
@@ -234,7 +293,7 @@ void MainWindow::OpenObjFile()
                     {
                         DebugPrint(L"[INF] Open obj file: %s", pszFilePath);
 
-                        m_objModel.LoadFromObjFile(pszFilePath);
+                        LoadModel(pszFilePath);
 
                         constexpr UINT32 MAX_CHARS = 1024;
                         WCHAR s_buffer[MAX_CHARS];
@@ -279,4 +338,93 @@ void MainWindow::OpenObjFile()
         DebugPrint(L"[WRN] CoInitializeEx Failed.");
         std::abort();
     }
+}
+
+MainWindow::~MainWindow()
+{
+    StopLoader();
+}
+
+void MainWindow::StopLoader()
+{
+    if (m_loader.joinable())
+    {
+        m_stopLoading = true;
+        m_loader.join();
+        m_stopLoading = false;
+    }
+}
+
+void MainWindow::LoadModel(const std::wstring & path)
+{
+    StopLoader();
+
+    std::wstring extension(CompressedMesh::EXTENSION);
+    if (path.size() > extension.size() &&
+        _wcsicmp(path.c_str() + path.size() - extension.size(),
+                 extension.c_str()) == 0)
+    {
+        auto t1 = Clock::now();
+        auto model = std::make_shared<ObjModel>();
+        if (!model->LoadFromCompressedFile(path))
+        {
+            std::abort();
+        }
+        if (m_cleanupMesh) { model->CleanupMesh(); }
+        auto t2 = Clock::now();
+        DebugPrint(L"[INF] Load compressed mesh in %.3f ms.",
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       t2 - t1).count() / 1000.0f);
+
+        std::lock_guard<std::mutex> lock(m_modelMutex);
+        m_objModel = model;
+        return;
+    }
+
+    // Obj files are loaded in the background, the window shows the part
+    // loaded so far and is repainted whenever a newer snapshot arrives.
+    m_loader = std::thread([this, path, cleanup = m_cleanupMesh]()
+    {
+        auto t1 = Clock::now();
+        bool first = true;
+        std::shared_ptr<ObjModel> last;
+        ObjModel::LoadFromObjFileProgressive(path, FACES_PER_SNAPSHOT,
+            [this]() { return m_stopLoading.load(); },
+            [this, cleanup, &t1, &first, &last](
+                std::shared_ptr<ObjModel> snapshot, bool final)
+        {
+            if (first)
+            {
+                DebugPrint(L"[INF] First snapshot in %.3f ms.",
+                           std::chrono::duration_cast<
+                               std::chrono::microseconds>(
+                               Clock::now() - t1).count() / 1000.0f);
+                first = false;
+            }
+            // A published snapshot may be drawing at any time, so the
+            // complete model is copied before it is published, and the copy
+            // is cleaned up.
+            if (final && cleanup)
+            {
+                last = std::make_shared<ObjModel>(*snapshot);
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_modelMutex);
+                m_objModel = std::move(snapshot);
+            }
+            InvalidateRect(m_hwnd, NULL, FALSE);
+        });
+        DebugPrint(L"[INF] Load obj file in %.3f ms.",
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       Clock::now() - t1).count() / 1000.0f);
+        if (m_stopLoading || !last) { return; }
+
+        // last is the copy of the complete model only this thread sees.
+        last->CleanupMesh();
+        {
+            std::lock_guard<std::mutex> lock(m_modelMutex);
+            m_objModel = std::move(last);
+        }
+        InvalidateRect(m_hwnd, NULL, FALSE);
+    });
 }
\ No newline at end of file
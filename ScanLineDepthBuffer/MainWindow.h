@@ -1,6 +1,10 @@
 ﻿#pragma once
 
 #include <string>
+#include <memory>  // std::shared_ptr
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <Windows.h>
 #include "BaseWindow.h"
 #include "ObjModel.h"
@@ -12,8 +16,26 @@ public:
     PCWSTR ClassName() const override { return L"MainWindow"; }
     LRESULT HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam) override;
 
+    ~MainWindow();
+
     void OpenObjFile();
 
 private:
-    ObjModel m_objModel;
+    // Number of faces after which the first partial model is shown while
+    // loading, see ObjModel::LoadFromObjFileProgressive().
+    static constexpr size_t FACES_PER_SNAPSHOT = 4096;
+
+    // Current model, replaced by m_loader while loading.
+    std::shared_ptr<ObjModel> m_objModel;
+    std::mutex m_modelMutex;
+
+    std::thread m_loader;
+    std::atomic<bool> m_stopLoading{false};
+
+    // Whether LoadModel() runs ObjModel::CleanupMesh() on the models it
+    // loads, off by default as it may change the image.
+    bool m_cleanupMesh = false;
+
+    void LoadModel(const std::wstring & path);
+    void StopLoader();
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "MappedFile.h"
+
+bool MappedFile::Open(const std::wstring & filePath)
+{
+    Close();
+
+    m_file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                         NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size))
+    {
+        Close();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+
+    // A zero-length file cannot be mapped, but it is still a valid file.
+    if (m_size == 0) { return true; }
+
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0,
+                                   NULL);
+    if (m_mapping == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    m_data = static_cast<const char *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+    if (m_mapping != NULL)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <Windows.h>
+
+/*
+ * Read-only view of a whole file mapped into memory.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    // Return false if the file cannot be opened or mapped, it is up to the
+    // caller to report it. An empty file is opened successfully, with
+    // GetData() == nullptr and GetSize() == 0.
+    bool Open(const std::wstring & filePath);
+    void Close();
+
+    const char * GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    HANDLE m_file{INVALID_HANDLE_VALUE};
+    HANDLE m_mapping{NULL};
+    const char * m_data{nullptr};
+    size_t m_size{0};
+};
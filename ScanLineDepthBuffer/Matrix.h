@@ -50,13 +50,14 @@ Matrix<T, N> operator*(const Matrix<T, N> &lhs, const Matrix<T, N> &rhs)
 template <typename T>
 Quaternion<T> operator*(const Matrix<T, 4> &lhs, const Quaternion<T> &rhs)
 {
-    Quaternion<T> q{ };
+    const T v[4] = {rhs.x, rhs.y, rhs.z, rhs.w};
+    T q[4] = { };
     for (auto i = 0; i < 4; ++i)
         for (auto j = 0; j < 4; ++j)
         {
-            q.val[i] += lhs.m_val[i][j] * rhs.val[j];
+            q[i] += lhs.m_val[i][j] * v[j];
         }
-    return q;
+    return {q[0], q[1], q[2], q[3]};
 }
 
 template <typename T>
@@ -0,0 +1,167 @@
+#include <cstring>  // std::memcmp() std::memcpy()
+#include "MeshCache.h"
+#include "FileWriter.h"
+#include "DebugPrint.h"
+
+static const char MAGIC[8] = {'S', 'L', 'D', 'B', 'M', 'E', 'S', 'H'};
+
+std::wstring MeshCache::GetCachePath(const std::wstring & objPath)
+{
+    return objPath + L".meshcache";
+}
+
+bool MeshCache::GetSourceInfo(const std::wstring & filePath, bool withHash,
+                              SourceInfo & info)
+{
+    HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    FILETIME writeTime;
+    bool ok = GetFileSizeEx(file, &size) &&
+              GetFileTime(file, NULL, NULL, &writeTime);
+    CloseHandle(file);
+    if (!ok) { return false; }
+
+    info.size = static_cast<unsigned long long>(size.QuadPart);
+    info.writeTime =
+        static_cast<unsigned long long>(writeTime.dwHighDateTime) << 32 |
+        writeTime.dwLowDateTime;
+    info.hash = 0;
+
+    if (withHash)
+    {
+        MappedFile content;
+        if (!content.Open(filePath)) { return false; }
+
+        // 64-bit FNV-1a, fed with 8 bytes at a time.
+        unsigned long long h = 14695981039346656037ull;
+        const char *p = content.GetData();
+        size_t n = content.GetSize();
+        for (; n >= 8; p += 8, n -= 8)
+        {
+            unsigned long long word;
+            std::memcpy(&word, p, 8);
+            h = (h ^ word) * 1099511628211ull;
+        }
+        for (; n != 0; ++p, --n)
+        {
+            h = (h ^ static_cast<UINT8>(*p)) * 1099511628211ull;
+        }
+        info.hash = h;
+    }
+    return true;
+}
+
+void MeshCache::InitHeader(Header & header)
+{
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.realSize = sizeof(REAL);
+}
+
+bool MeshCache::Open(const std::wstring & cachePath,
+                     const std::wstring & sourcePath)
+{
+    m_file.Close();
+
+    SourceInfo source;
+    if (!GetSourceInfo(sourcePath, false, source)) { return false; }
+    if (!m_file.Open(cachePath)) { return false; }
+
+    if (m_file.GetSize() < sizeof(Header))
+    {
+        m_file.Close();
+        return false;
+    }
+    const Header &header = GetHeader();
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.realSize != sizeof(REAL))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    m_vertexPos = Align8(sizeof(Header));
+    m_offsetPos = Align8(m_vertexPos +
+                         header.vertexCount * sizeof(REAL) * 3ull);
+    m_faceVertexPos = Align8(m_offsetPos +
+                             (header.faceCount + 1ull) * sizeof(UINT32));
+    m_faceAttributePos = Align8(m_faceVertexPos +
+                                header.nodeCount * sizeof(INT32));
+    if (m_faceAttributePos + header.nodeCount * sizeof(INT32) * 2ull !=
+        m_file.GetSize())
+    {
+        DebugPrint(L"[WRN] MeshCache::Open : Damaged cache: %s",
+                   cachePath.c_str());
+        m_file.Close();
+        return false;
+    }
+
+    // Source file changed, or the time stamp is different but the content
+    // may still be the same.
+    if (header.source.size != source.size)
+    {
+        m_file.Close();
+        return false;
+    }
+    if (header.source.writeTime != source.writeTime)
+    {
+        if (!GetSourceInfo(sourcePath, true, source) ||
+            header.source.hash != source.hash)
+        {
+            m_file.Close();
+            return false;
+        }
+    }
+
+    // Guard against damaged indices, so that they never reach the renderer.
+    const UINT32 *offsets = GetFaceOffsets();
+    if (offsets[0] != 0 || offsets[header.faceCount] != header.nodeCount)
+    {
+        m_file.Close();
+        return false;
+    }
+    for (UINT32 i = 0; i != header.faceCount; ++i)
+    {
+        if (offsets[i + 1] < offsets[i] + 3)
+        {
+            m_file.Close();
+            return false;
+        }
+    }
+    const INT32 *faceVertices = GetFaceVertices();
+    for (UINT32 i = 0; i != header.nodeCount; ++i)
+    {
+        if (faceVertices[i] < 0 ||
+            static_cast<UINT32>(faceVertices[i]) > header.vertexCount)
+        {
+            m_file.Close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MeshCache::Write(const std::wstring & cachePath, const Header & header,
+                      const REAL * vertices, const UINT32 * faceOffsets,
+                      const INT32 * faceVertices,
+                      const INT32 * faceAttributes)
+{
+    FileWriter writer;
+    return writer.Open(cachePath) &&
+        writer.WriteAligned(&header, sizeof(header)) &&
+        writer.WriteAligned(vertices,
+                            header.vertexCount * sizeof(REAL) * 3ull) &&
+        writer.WriteAligned(faceOffsets,
+                            (header.faceCount + 1ull) * sizeof(UINT32)) &&
+        writer.WriteAligned(faceVertices,
+                            header.nodeCount * sizeof(INT32)) &&
+        writer.WriteAligned(faceAttributes,
+                            header.nodeCount * sizeof(INT32) * 2ull) &&
+        writer.Commit();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <Windows.h>
+#include "Types.h"
+#include "MappedFile.h"
+
+/*
+ * Binary sidecar of an obj file, so that a model can be loaded by mapping
+ * one file instead of parsing text.
+ *
+ * File Layout (native byte order, every part 8-byte aligned):
+ *
+ *     Header
+ *     REAL  vertices[vertexCount][3]      x y z, vertex #1 comes first
+ *     UINT32 faceOffsets[faceCount + 1]   face i is nodes offsets[i] to
+ *                                         offsets[i + 1] - 1
+ *     INT32 faceVertices[nodeCount]       v of every node
+ *     INT32 faceAttributes[nodeCount][2]  vt vn of every node
+ *
+ * The cache is valid only for the source file it was written from. It is
+ * identified by size and last write time, and by a content hash when the
+ * time stamp differs (e.g. after copying the model to another folder).
+ */
+class MeshCache
+{
+public:
+    static constexpr UINT32 VERSION = 2;
+
+    struct SourceInfo
+    {
+        unsigned long long size;
+        unsigned long long writeTime;
+        unsigned long long hash;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        UINT32 version;
+        UINT32 realSize;  // sizeof(REAL) when written
+        SourceInfo source;
+        UINT32 vertexCount;
+        UINT32 faceCount;
+        UINT32 nodeCount;
+        UINT32 reserved;
+        double box[6];  // xmin xmax ymin ymax zmin zmax
+    };
+
+    // Path of the cache file of an obj file.
+    static std::wstring GetCachePath(const std::wstring & objPath);
+
+    // Read size and last write time of file. The content hash is only
+    // computed when withHash is true, since it reads the whole file.
+    static bool GetSourceInfo(const std::wstring & filePath, bool withHash,
+                              SourceInfo & info);
+
+    // Map cachePath and check it against source. Return false if there is no
+    // cache, or it is stale or damaged.
+    bool Open(const std::wstring & cachePath, const std::wstring & sourcePath);
+
+    const Header & GetHeader() const
+    {
+        return *reinterpret_cast<const Header *>(m_file.GetData());
+    }
+    const REAL * GetVertices() const
+    {
+        return reinterpret_cast<const REAL *>(m_file.GetData() + m_vertexPos);
+    }
+    const UINT32 * GetFaceOffsets() const
+    {
+        return reinterpret_cast<const UINT32 *>(m_file.GetData() +
+                                                m_offsetPos);
+    }
+    const INT32 * GetFaceVertices() const
+    {
+        return reinterpret_cast<const INT32 *>(m_file.GetData() +
+                                               m_faceVertexPos);
+    }
+    const INT32 * GetFaceAttributes() const
+    {
+        return reinterpret_cast<const INT32 *>(m_file.GetData() +
+                                               m_faceAttributePos);
+    }
+
+    // Write a cache file, a half written cache is never picked up.
+    static bool Write(const std::wstring & cachePath, const Header & header,
+                      const REAL * vertices, const UINT32 * faceOffsets,
+                      const INT32 * faceVertices,
+                      const INT32 * faceAttributes);
+
+    // Fill magic, version and realSize of header.
+    static void InitHeader(Header & header);
+
+private:
+    MappedFile m_file;
+    size_t m_vertexPos{0};
+    size_t m_offsetPos{0};
+    size_t m_faceVertexPos{0};
+    size_t m_faceAttributePos{0};
+
+    static size_t Align8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+};
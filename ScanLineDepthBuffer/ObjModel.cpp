@@ -1,17 +1,24 @@
 ﻿#include <string>
-#include <fstream>
-#include <sstream>
 #include <cassert>  // assert()
 #include <cmath>  // std::lround() std::sqrt()
 #include <utility>  // std::swap()
+#include <algorithm>  // std::copy() std::move() std::rotate() std::sort()
+#include <cstring>  // std::memcpy()
+#include <unordered_map>
+#include <limits>  // std::numeric_limits
 #include "ObjModel.h"
 #include "FloatingPoint.h"
 #include "DebugPrint.h"
 #include "Transformation.h"
-#include "Matrix.h"
-#include "Tuple.h" // Vector4R
+#include "Affine.h"
+#include "MappedFile.h"
+#include "CompressedMesh.h"
+#include "ObjParser.h"
+#include "Parallel.h"
+#include "VertexTransform.h"
 
-void ObjModel::LoadFromObjFile(const std::wstring & filePath)
+void ObjModel::LoadFromObjFile(const std::wstring & filePath,
+                               UINT32 threadCount)
 {
     // NOTE(jaege): Only polygonal objects are partially supported, free-form
     //     objects are not supported.
@@ -22,513 +29,2681 @@ void ObjModel::LoadFromObjFile(const std::wstring & filePath)
     //     geometric vertices (v)
     //     vertex normals (vn)
     //     face (f)
+    //
+    // The file is mapped into memory and tokenized in place, so no memory is
+    // allocated per line or per token. Large files are split at line breaks
+    // into one chunk per thread, the chunks are parsed in parallel and then
+    // concatenated in file order, so the result does not depend on the
+    // number of threads.
+    //
+    // The parsed model is saved to a binary mesh cache next to the file, and
+    // later loads of the same file read the cache instead.
 
     m_filePath = filePath;
 
-    std::ifstream fileStream(m_filePath);
+    if (m_useMeshCache && LoadFromMeshCache()) { return; }
 
-    if (!fileStream.is_open())
+    MeshCache::SourceInfo source;
+    bool saveCache = m_useMeshCache &&
+        MeshCache::GetSourceInfo(m_filePath, true, source);
+
+    MappedFile file;
+    if (!file.Open(m_filePath))
     {
         DebugPrint(L"[WRN] ObjModel::LoadFromObjFile : Fail to open file: %s",
-                   m_filePath);
+                   m_filePath.c_str());
         std::abort();
     }
 
-    std::string line;
+    const char *data = file.GetData();
+    const char *end = data + file.GetSize();
 
-    Position3R pos{ };
-    m_vertices.push_back(pos);
+    if (threadCount == 0)
+    {
+        threadCount = file.GetSize() < PARALLEL_LOAD_MIN_BYTES ?
+            1 : Parallel::GetThreadCount();
+    }
+
+    // Chunk i is [bounds[i], bounds[i + 1]), every chunk starts at the
+    // beginning of a line.
+    std::vector<const char *> bounds(threadCount + 1, end);
+    bounds[0] = data;
+    for (UINT32 i = 1; i < threadCount; ++i)
+    {
+        const char *p = data + file.GetSize() / threadCount * i;
+        if (p < bounds[i - 1]) p = bounds[i - 1];
+        if (p != data && p[-1] != '\n') ObjParser::SkipLine(p, end);
+        bounds[i] = p;
+    }
+
+    std::vector<ObjChunk> chunks(threadCount);
+    Parallel::For(threadCount, [&](UINT32 i)
+    {
+        ParseObjChunk(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    // Vertex numbering starts from 1, so does the vertex texture and normal
+    // numbering.
+    m_vertices.assign(1, Position3R{ });  // m_vertices[0] is a placeholder
     //m_vertexNormals.push_back(pos);
+    m_faceIds.clear();
+    InvalidateDerivedData();
+    m_faces.offsets.assign(1, 0);
+    m_faces.vertices.clear();
+    m_faces.attributes.clear();
+    m_box = BoundingBox();
+    ObjChunk::Counts total{1, 1, 1};
+    AppendObjChunks(chunks, threadCount, total);
+
+    for (int v : m_faces.vertices)
+        assert(v >= 0 && v < total.v);
+    for (const auto &attributes : m_faces.attributes)
+        assert(attributes.vt >= 0 && attributes.vn >= 0);
+
+    DebugPrint(L"[INF] Model has %d vertices, %d faces.",
+               m_vertices.size() - 1, m_faces.GetCount());
+
+    if (saveCache) { SaveMeshCache(source); }
+}
 
-    while (std::getline(fileStream, line))
+void ObjModel::AppendFaces(const FaceTable & source, size_t faceFirst,
+                           size_t nodeFirst, FaceTable & target)
+{
+    UINT32 nodeOffset = static_cast<UINT32>(nodeFirst);
+    for (size_t i = 0; i != source.GetCount(); ++i)
     {
-        std::istringstream iss(line);
-        std::string keyword, faceStrBuffer;
-        iss >> keyword;
+        target.offsets[faceFirst + i + 1] = nodeOffset + source.offsets[i + 1];
+    }
+    std::copy(source.vertices.begin(), source.vertices.end(),
+              target.vertices.begin() + nodeFirst);
+    std::copy(source.attributes.begin(), source.attributes.end(),
+              target.attributes.begin() + nodeFirst);
+}
 
-        switch (keyword[0])
-        {
-        case 'v':
-            iss >> pos.x >> pos.y >> pos.z;
-            switch (keyword[1])
-            {
-            case '\0':
-                // v x y z w
-                // w is ignored.
-                if (m_box.xmin > pos.x) m_box.xmin = pos.x;
-                if (m_box.xmax < pos.x) m_box.xmax = pos.x;
-                if (m_box.ymin > pos.y) m_box.ymin = pos.y;
-                if (m_box.ymax < pos.y) m_box.ymax = pos.y;
-                if (m_box.zmin > pos.z) m_box.zmin = pos.z;
-                if (m_box.zmax < pos.z) m_box.zmax = pos.z;
-                m_vertices.push_back(pos);
-                break;
+void ObjModel::AppendObjChunks(std::vector<ObjChunk> & chunks, UINT32 count,
+                               ObjChunk::Counts & total)
+{
+    // Exclusive prefix sums of the per-chunk counts give the global position
+    // of each chunk.
+    std::vector<ObjChunk::Counts> firsts(count);
+    std::vector<size_t> faceFirsts(count + 1);
+    std::vector<size_t> nodeFirsts(count + 1);
+    faceFirsts[0] = m_faces.GetCount();
+    nodeFirsts[0] = m_faces.vertices.size();
+    for (UINT32 i = 0; i < count; ++i)
+    {
+        const ObjChunk &chunk = chunks[i];
+        firsts[i] = total;
+        total.v += static_cast<int>(chunk.vertices.size());
+        total.vt += chunk.counts.vt;
+        total.vn += chunk.counts.vn;
+        faceFirsts[i + 1] = faceFirsts[i] + chunk.faces.GetCount();
+        nodeFirsts[i + 1] = nodeFirsts[i] + chunk.faces.vertices.size();
 
-            //case 'n':
-            //    // vn i j k
-            //    // vn is ignored.
-            //    m_vertexNormals.push_back(pos);
-            //    break;
+        if (m_box.xmin > chunk.box.xmin) m_box.xmin = chunk.box.xmin;
+        if (m_box.xmax < chunk.box.xmax) m_box.xmax = chunk.box.xmax;
+        if (m_box.ymin > chunk.box.ymin) m_box.ymin = chunk.box.ymin;
+        if (m_box.ymax < chunk.box.ymax) m_box.ymax = chunk.box.ymax;
+        if (m_box.zmin > chunk.box.zmin) m_box.zmin = chunk.box.zmin;
+        if (m_box.zmax < chunk.box.zmax) m_box.zmax = chunk.box.zmax;
+    }
 
-            default:
-                // vp and vt are ignored.
-                break;
-            }
-            break;
+    m_vertices.resize(total.v);
+    m_faces.offsets.resize(faceFirsts[count] + 1);
+    m_faces.vertices.resize(nodeFirsts[count]);
+    m_faces.attributes.resize(nodeFirsts[count]);
 
-        case 'f':
-            // f  v1/vt1/vn1   v2/vt2/vn2   v3/vt3/vn3 ...
-            // Negative indices are not supported.
-            // vt and vn are optional.
-            // Index 0 means not present in file.
+    Parallel::For(count, [&](UINT32 i)
+    {
+        ObjChunk &chunk = chunks[i];
+
+        for (const auto &r : chunk.relativeIndices)
+        {
+            switch (r.attribute)
             {
-                std::vector<FaceNode> face;
-                int v, vt, vn;
-                while (iss >> faceStrBuffer)
-                {
-                    std::istringstream fsb(faceStrBuffer);
-                    faceStrBuffer = "";
-                    std::getline(fsb, faceStrBuffer, '/');
-                    v = faceStrBuffer == "" ? 0 : std::stoi(faceStrBuffer);
-                    faceStrBuffer = "";
-                    std::getline(fsb, faceStrBuffer, '/');
-                    vt = faceStrBuffer == "" ? 0 : std::stoi(faceStrBuffer);
-                    faceStrBuffer = "";
-                    std::getline(fsb, faceStrBuffer, '/');
-                    vn = faceStrBuffer == "" ? 0 : std::stoi(faceStrBuffer);
-                    assert(v >= 0 && vt >= 0 && vn >= 0);
-                    face.push_back({v, vt, vn});
-                }
-                if (face.size() < 3)
-                {
-                    DebugPrint(L"[ERR] Face has less than three vertices.");
-                    std::abort();
-                }
-                // Add the first vertex to the last, used for generating
-                // edge table.
-                face.push_back(face[0]);
-                m_faces.push_back(face);
+            case 0: chunk.faces.vertices[r.node] += firsts[i].v; break;
+            case 1: chunk.faces.attributes[r.node].vt += firsts[i].vt; break;
+            case 2: chunk.faces.attributes[r.node].vn += firsts[i].vn; break;
             }
-            break;
-
-        default:
-            // Ignore other cases.
-            break;
         }
-    }
 
-    DebugPrint(L"[INF] Model has %d vertices, %d faces.",
-               m_vertices.size() - 1, m_faces.size());
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+                  m_vertices.begin() + firsts[i].v);
+        AppendFaces(chunk.faces, faceFirsts[i], nodeFirsts[i], m_faces);
+    });
 }
 
-void ObjModel::TransformModel(INT32 width, INT32 height, REAL scaleFactor,
-                              REAL degreeX, REAL degreeY,
-                              REAL shiftX, REAL shiftY)
+void ObjModel::LoadFromObjFileProgressive(
+    const std::wstring & filePath, size_t facesPerSnapshot,
+    const std::function<bool()> & stopRequested,
+    const std::function<void(std::shared_ptr<ObjModel>, bool final)> &
+        onSnapshot)
 {
-    assert(scaleFactor > 0);
-    REAL xScale = width / (m_box.xmax - m_box.xmin);
-    REAL yScale = height / (m_box.ymax - m_box.ymin);
-
-    // Ensure that the whole object can be seen in screen when scaleFactor <= 1.
-    REAL scale = min(xScale, yScale) * scaleFactor;
+    // The model being loaded, snapshots are copies of it.
+    ObjModel model;
+    model.m_filePath = filePath;
 
-    // The matrices are mulitplied in reverse order, i.e. last tranformation comes first.
-    Matrix4x4R transform =
-        Transformation::Translate(width / 2.0f + shiftX, height / 2.0f + shiftY, 0) *
-        Transformation::Scale(scale) *
-        Transformation::RotateAboutXAxis(degreeX) *
-        Transformation::RotateAboutYAxis(degreeY) *
-        Transformation::Symmetry(true, false, true) *
-        Transformation::Translate(-(m_box.xmin + m_box.xmax) / 2,
-                                  -(m_box.ymin + m_box.ymax) / 2,
-                                  -(m_box.zmin + m_box.zmax) / 2);
+    if (model.LoadFromMeshCache())
+    {
+        onSnapshot(std::make_shared<ObjModel>(std::move(model)), true);
+        return;
+    }
 
-    m_transformedVertices.clear();
-    REAL left = REAL_MAX;
-    REAL right = REAL_MIN;
-    REAL top = REAL_MAX;
-    REAL bottom = REAL_MIN;
+    MeshCache::SourceInfo source;
+    bool saveCache = MeshCache::GetSourceInfo(filePath, true, source);
 
-    for (auto &v : m_vertices)
+    MappedFile file;
+    if (!file.Open(filePath))
     {
-        Vector4R newPos = transform * Vector4R{v.x, v.y, v.z, 1.0f};
-        if (newPos.x < left) left = newPos.x;
-        if (newPos.x > right) right = newPos.x;
-        if (newPos.y < top) top = newPos.y;
-        if (newPos.y > bottom) bottom = newPos.y;
-        // TODO(jaege): find out why the following push_back call cannot be
-        //     moved before comparing x and y.
-        m_transformedVertices.push_back({newPos.x, newPos.y, newPos.z});
+        DebugPrint(L"[WRN] ObjModel::LoadFromObjFileProgressive : Fail to "
+                   "open file: %s", filePath.c_str());
+        std::abort();
     }
 
-    // Round inside the bounding rectangle.
-    m_boundingRect.left = static_cast<LONG>(std::ceil(left));  // xmin'
-    m_boundingRect.right = static_cast<LONG>(std::floor(right));  // xmax'
-    m_boundingRect.top = static_cast<LONG>(std::ceil(top));  // ymin'
-    m_boundingRect.bottom = static_cast<LONG>(std::floor(bottom));  // ymax'
-}
+    const char *p = file.GetData();
+    const char *end = p + file.GetSize();
 
-template <typename T>
-ObjModel::Plane<typename T::value_type> ObjModel::GetPlane(T p1, T p2, T p3)
-{
-    T::value_type a = (p2.y - p1.y) * (p3.z - p1.z) -
-        (p3.y - p1.y) * (p2.z - p1.z);
-    T::value_type b = (p3.x - p1.x) * (p2.z - p1.z) -
-        (p2.x - p1.x) * (p3.z - p1.z);
-    T::value_type c = (p2.x - p1.x) * (p3.y - p1.y) -
-        (p3.x - p1.x) * (p2.y - p1.y);
-    T::value_type d = -(p1.x * a + p1.y * b + p1.z * c);
-    T::value_type n = std::sqrt(a * a + b * b + c * c);
-    assert(n != 0);
-    // Normalize (a, b, c) so that this is the normal vector of the face.
-    return{a / n, b / n, c / n, d / n};
-}
+    model.m_vertices.push_back({ });  // m_vertices[0] is a placeholder
 
-void ObjModel::InitTables()
-{
-    m_planes.clear();
-    m_planes.resize(m_boundingRect.bottom - m_boundingRect.top + 1);
+    // Same as in LoadFromObjFile(), every slice is parsed as a chunk, a
+    // slice per thread at a time, and the chunks are appended to the model.
+    const UINT32 threadCount = Parallel::GetThreadCount();
+    std::vector<const char *> bounds(threadCount + 1);
+    std::vector<ObjChunk> chunks(threadCount);
+    ObjChunk::Counts total{1, 1, 1};
+    size_t nextSnapshot = facesPerSnapshot;
+    int maxVertexId = 0;
+    while (p != end)
+    {
+        if (stopRequested()) { return; }
+
+        UINT32 count = 0;
+        bounds[0] = p;
+        while (count != threadCount && p != end)
+        {
+            p = static_cast<size_t>(end - p) > PROGRESSIVE_SLICE_BYTES ?
+                p + PROGRESSIVE_SLICE_BYTES : end;
+            if (p != end && p[-1] != '\n')
+            {
+                ObjParser::SkipLine(p, end);
+            }
+            bounds[++count] = p;
+        }
 
-    m_edges.clear();
-    m_edges.resize(m_boundingRect.bottom - m_boundingRect.top + 1);
+        Parallel::For(count, [&](UINT32 i)
+        {
+            chunks[i] = ObjChunk();
+            ParseObjChunk(bounds[i], bounds[i + 1], chunks[i]);
+        });
 
-    REAL lightN = 1 / std::sqrt(m_light.x * m_light.x + m_light.y * m_light.y +
-                                m_light.z * m_light.z);
+        FaceTable &faces = model.m_faces;
+        const size_t nodeFirst = faces.vertices.size();
+        model.AppendObjChunks(chunks, count, total);
+        for (size_t i = nodeFirst; i != faces.vertices.size(); ++i)
+        {
+            if (maxVertexId < faces.vertices[i])
+            {
+                maxVertexId = faces.vertices[i];
+            }
+        }
 
-    for (int pid = 0; pid != m_faces.size(); ++pid)
-    {
-        const auto &face = m_faces[pid];
-        PlaneNode pn;
-
-        // Always use first 3 vertices to calculate the plane equation.
-        // face[i].v is vertex id.
-        pn.plane = GetPlane(m_transformedVertices[face[0].v],
-                            m_transformedVertices[face[1].v],
-                            m_transformedVertices[face[2].v]);
-        // NOTE(jaege): Only plane face is supported, all vertices must in the
-        //     same plane. The planse is assured to have at least 3 vertices.
-        // BUG(jaege): check why assert fail when it shouldn't.
-        //for (auto it = face.cbegin() + 3; it != face.cend(); ++it)
-        //{
-        //    const auto &p = m_transformedVertices[it->v];
-        //    FloatingPoint<REAL> lhs(p.x * pn.plane.a + p.y * pn.plane.b +
-        //                            p.z * pn.plane.c + pn.plane.d), rhs(0.0f);
-        //    assert(lhs.AlmostEquals(rhs));
-        //}
-
-        // Ignore planes that parallel to z axis.
-        FloatingPoint<REAL> lhs(pn.plane.c), rhs(0.0f);
-        if (lhs.AlmostEquals(rhs)) { continue; }
-
-        pn.id = pid;
-
-        INT32 topyi = m_boundingRect.bottom + 1;
-        INT32 btmyi = m_boundingRect.top - 1;
-        for (int vid = 0; vid != face.size() - 1; ++vid)
-        {
-            const auto *ptop = &m_transformedVertices[face[vid].v];
-            const auto *pbtm = &m_transformedVertices[face[vid + 1].v];
-
-            if (ptop->y > pbtm->y)
-            {
-                auto p = ptop;
-                ptop = pbtm;
-                pbtm = p;
-                //std::swap(ptop, pbtm);
+        // A snapshot must not refer to vertices that are not read yet.
+        if (p != end && faces.GetCount() >= nextSnapshot &&
+            maxVertexId < total.v)
+        {
+            onSnapshot(std::make_shared<ObjModel>(model), false);
+            nextSnapshot = faces.GetCount() * 2;
+            if (nextSnapshot < faces.GetCount() + facesPerSnapshot)
+            {
+                nextSnapshot = faces.GetCount() + facesPerSnapshot;
             }
+        }
+    }
+
+    for (int v : model.m_faces.vertices)
+        assert(v >= 0 && v < total.v);
+    for (const auto &attributes : model.m_faces.attributes)
+        assert(attributes.vt >= 0 && attributes.vn >= 0);
 
-            INT32 ptopyi = static_cast<INT32>(std::floor(ptop->y + 1.0f));
-            INT32 pbtmyi = static_cast<INT32>(std::floor(pbtm->y));
+    DebugPrint(L"[INF] Model has %d vertices, %d faces.",
+               model.m_vertices.size() - 1, model.m_faces.GetCount());
 
-            if (topyi > ptopyi) topyi = ptopyi;
-            if (btmyi < pbtmyi) btmyi = pbtmyi;
+    if (saveCache) { model.SaveMeshCache(source); }
 
-            // Ignore horizontal edges that stay between two adjcent scan-lines.
-            // Some edges may not parallel to x axis, but their projections on
-            // y axis is so small that not intersect with any scan-lines. They
-            // should also be omited.
-            // NOTE(jaege): When ptopyi==pbtmyi, the edge is still need to add
-            //     to the edge tables, because it intersectes with scan-line.
-            if (ptopyi > pbtmyi) { continue; }
+    onSnapshot(std::make_shared<ObjModel>(std::move(model)), true);
+}
 
-            EdgeNode edge;
+bool ObjModel::LoadFromMeshCache()
+{
+    static_assert(sizeof(Position3R) == sizeof(REAL) * 3,
+                  "Position3R must be three packed REALs");
+    static_assert(sizeof(FaceAttributes) == sizeof(INT32) * 2,
+                  "FaceAttributes must be two packed INT32s");
 
-            edge.dx = (ptop->x - pbtm->x) / (ptop->y - pbtm->y);
-            edge.planeId = pid;
-            edge.xtop = ptop->x - edge.dx * (ptop->y - ptopyi);
-            edge.diffy = pbtmyi - ptopyi + 1;
-            m_edges[ptopyi - m_boundingRect.top].push_back(edge);
-        }
+    MeshCache cache;
+    if (!cache.Open(MeshCache::GetCachePath(m_filePath), m_filePath))
+    {
+        return false;
+    }
 
-        pn.diffy = btmyi - topyi + 1;
-        // Some planes may not parallel to z axis, but their projections on
-        // y axis is so small that not intersect with any scan-lines. They
-        // should also be ignored.
-        if (pn.diffy <= 0) { continue; }
+    const MeshCache::Header &header = cache.GetHeader();
 
-        // Calculate color from the angle of face normal n, which is
-        // n(a, b, c), and the light direction normal l(i, j, k). The smaller
-        // the angle is, the light the color is.
-        //
-        //     n(a, b, c) dot l(i, j, k) = |n|*|l|*cos(theta)
+    m_vertices.clear();
+    // m_vertices[0] is a placeholder.
+    m_vertices.resize(header.vertexCount + 1);
+    std::memcpy(m_vertices.data() + 1, cache.GetVertices(),
+                header.vertexCount * sizeof(Position3R));
 
-        REAL costheta = (pn.plane.a * m_light.x + pn.plane.b * m_light.y +
-                         pn.plane.c * m_light.z) * lightN;
-        costheta = 0.5f - costheta / 2;
+    m_faceIds.clear();
+    InvalidateDerivedData();
+    m_faces.offsets.assign(cache.GetFaceOffsets(),
+                           cache.GetFaceOffsets() + header.faceCount + 1);
+    m_faces.vertices.assign(cache.GetFaceVertices(),
+                            cache.GetFaceVertices() + header.nodeCount);
+    const FaceAttributes *attributes =
+        reinterpret_cast<const FaceAttributes *>(cache.GetFaceAttributes());
+    m_faces.attributes.assign(attributes, attributes + header.nodeCount);
 
-        pn.color.red = static_cast<UINT8>(std::round(m_planeColor.red * costheta));
-        pn.color.green = static_cast<UINT8>(std::round(m_planeColor.green * costheta));
-        pn.color.blue = static_cast<UINT8>(std::round(m_planeColor.blue * costheta));
+    m_box.xmin = static_cast<REAL>(header.box[0]);
+    m_box.xmax = static_cast<REAL>(header.box[1]);
+    m_box.ymin = static_cast<REAL>(header.box[2]);
+    m_box.ymax = static_cast<REAL>(header.box[3]);
+    m_box.zmin = static_cast<REAL>(header.box[4]);
+    m_box.zmax = static_cast<REAL>(header.box[5]);
 
-        m_planes[topyi - m_boundingRect.top].push_back(pn);
-    }
+    DebugPrint(L"[INF] Model has %d vertices, %d faces (from mesh cache).",
+               m_vertices.size() - 1, m_faces.GetCount());
+    return true;
 }
 
-void ObjModel::GetBuffer(OffscreenBuffer &buffer, REAL scaleFactor,
-                         REAL degreeX, REAL degreeY, REAL shiftX, REAL shiftY)
+void ObjModel::SaveMeshCache(const MeshCache::SourceInfo & source) const
 {
-    TransformModel(buffer.GetWidth(), buffer.GetHeight(), scaleFactor,
-                   degreeX, degreeY, shiftX, shiftY);
+    MeshCache::Header header;
+    MeshCache::InitHeader(header);
+    header.source = source;
+    header.vertexCount = static_cast<UINT32>(m_vertices.size() - 1);
+    header.faceCount = static_cast<UINT32>(m_faces.GetCount());
+    header.nodeCount = static_cast<UINT32>(m_faces.vertices.size());
+    GetBoxArray(header.box);
 
-    InitTables();
+    MeshCache::Write(MeshCache::GetCachePath(m_filePath), header,
+                     reinterpret_cast<const REAL *>(m_vertices.data() + 1),
+                     m_faces.offsets.data(), m_faces.vertices.data(),
+                     reinterpret_cast<const INT32 *>(
+                         m_faces.attributes.data()));
+}
 
-    std::vector<PlaneNode> activePlanes;
-    std::vector<ActiveEdgePairNode> activeEdgePairs;
-    INT32 height = buffer.GetHeight();
-    INT32 width = buffer.GetWidth();
-    Color background{30, 30, 30};
-    INT32 ybegin = m_boundingRect.top < 0 ? m_boundingRect.top : 0;
-    for (INT32 y = ybegin; y < height; ++y)
+void ObjModel::ParseObjChunk(const char * p, const char * end,
+                             ObjChunk & chunk)
+{
+    Position3R pos{ };
+    FaceTable &faces = chunk.faces;
+
+    while (p != end)
     {
-        std::vector<Color> frameBuffer(width, background);
-        std::vector<REAL> depthBuffer(width, REAL_MAX);
+        ObjParser::SkipBlanks(p, end);
 
-        if (y >= m_boundingRect.top && y <= m_boundingRect.bottom)
+        if (ObjParser::MatchKeyword(p, end, "v"))
+        {
+            // v x y z w
+            // w is ignored.
+            ObjParser::SkipBlanks(p, end);
+            ObjParser::ParseReal(p, end, pos.x);
+            ObjParser::SkipBlanks(p, end);
+            ObjParser::ParseReal(p, end, pos.y);
+            ObjParser::SkipBlanks(p, end);
+            ObjParser::ParseReal(p, end, pos.z);
+            if (chunk.box.xmin > pos.x) chunk.box.xmin = pos.x;
+            if (chunk.box.xmax < pos.x) chunk.box.xmax = pos.x;
+            if (chunk.box.ymin > pos.y) chunk.box.ymin = pos.y;
+            if (chunk.box.ymax < pos.y) chunk.box.ymax = pos.y;
+            if (chunk.box.zmin > pos.z) chunk.box.zmin = pos.z;
+            if (chunk.box.zmax < pos.z) chunk.box.zmax = pos.z;
+            chunk.vertices.push_back(pos);
+        }
+        else if (ObjParser::MatchKeyword(p, end, "vt"))
+        {
+            // Only counted, for resolving relative vt indices.
+            ++chunk.counts.vt;
+        }
+        else if (ObjParser::MatchKeyword(p, end, "vn"))
+        {
+            // Only counted, for resolving relative vn indices.
+            ++chunk.counts.vn;
+        }
+        else if (ObjParser::MatchKeyword(p, end, "f"))
         {
-            // Add planes from m_planes to activePlanes.
-            for (const auto &pl : m_planes[y - m_boundingRect.top])
+            // f  v1/vt1/vn1   v2/vt2/vn2   v3/vt3/vn3 ...
+            // vt and vn are optional.
+            // Index 0 means not present in file.
+            // Negative indices are relative to the end of the data read so
+            // far. Here they are made relative to the start of this chunk and
+            // fixed up once the chunk's position in the file is known.
+            for (;;)
             {
-                activePlanes.push_back(pl);
+                ObjParser::SkipBlanks(p, end);
+                if (ObjParser::IsStatementEnd(p, end)) { break; }
 
-                // Add edge pair of newly added plane to activeEdgePairs.
-                std::vector<EdgeNode> edges;
-                for (const auto &edge : m_edges[y - m_boundingRect.top])
+                int v = 0;
+                FaceAttributes attributes{0, 0};
+                ObjParser::ParseInt(p, end, v);
+                if (p != end && *p == '/')
                 {
-                    if (edge.planeId == pl.id) { edges.push_back(edge); }
+                    ++p;
+                    ObjParser::ParseInt(p, end, attributes.vt);
+                    if (p != end && *p == '/')
+                    {
+                        ++p;
+                        ObjParser::ParseInt(p, end, attributes.vn);
+                    }
                 }
-                // There should be even number of edges.
-                assert(edges.size() % 2 == 0);
-                if (edges.size() % 2 != 0)
+
+                UINT32 nodeId = static_cast<UINT32>(faces.vertices.size());
+                if (v < 0)
                 {
-                    DebugPrint(L"[ERR] Find odd number of edge pairs of plane "
-                               "#%d at y=%d.", pl.id, y);
+                    v += static_cast<int>(chunk.vertices.size());
+                    chunk.relativeIndices.push_back({nodeId, 0});
                 }
-                // TODO(jaege): handle the concave polygon case, which
-                //     means edges.size()=2n (n>1).
-
-                if (edges.size() == 0)
+                if (attributes.vt < 0)
                 {
-                    DebugPrint(L"[ERR] Can't find edge pair of plane "
-                               "#%d at y=%d.", pl.id, y);
-                    continue;
+                    attributes.vt += chunk.counts.vt;
+                    chunk.relativeIndices.push_back({nodeId, 1});
                 }
-
-                FloatingPoint<REAL> lhs(edges[0].xtop), rhs(edges[1].xtop);
-                if (edges[0].xtop > edges[1].xtop ||
-                    lhs.AlmostEquals(rhs) && edges[0].dx > edges[1].dx)
+                if (attributes.vn < 0)
                 {
-                    std::swap(edges[0], edges[1]);
+                    attributes.vn += chunk.counts.vn;
+                    chunk.relativeIndices.push_back({nodeId, 2});
                 }
+                faces.vertices.push_back(v);
+                faces.attributes.push_back(attributes);
 
-                ActiveEdgePairNode epn;
-                epn.l.x = edges[0].xtop;
-                epn.l.dx = edges[0].dx;
-                epn.l.diffy = edges[0].diffy;
-                epn.r.x = edges[1].xtop;
-                epn.r.dx = edges[1].dx;
-                epn.r.diffy = edges[1].diffy;
-                // NOTE(jaege): zl may lose some precision since y is rounded.
-                // TODO(jaege): Test if this is ok.
-                epn.zl = -(pl.plane.a * edges[0].xtop + pl.plane.b * y +
-                           pl.plane.d) / pl.plane.c;
-                epn.dzx = -pl.plane.a / pl.plane.c;
-                epn.dzy = -pl.plane.b / pl.plane.c;
-                epn.planeId = pl.id;
-
-                activeEdgePairs.push_back(epn);
+                // Skip the rest of a malformed token.
+                while (p != end && !ObjParser::IsBlank(*p) && *p != '\n') ++p;
+            }
+            if (faces.vertices.size() - faces.offsets.back() < 3)
+            {
+                DebugPrint(L"[ERR] Face has less than three vertices.");
+                std::abort();
             }
+            faces.offsets.push_back(
+                static_cast<UINT32>(faces.vertices.size()));
+        }
+
+        // vp and other statements are ignored.
+        ObjParser::SkipLine(p, end);
+    }
+}
+
+void ObjModel::InvalidateDerivedData()
+{
+    m_faceEdges.clear();
+    m_vertexArrays.x.clear();
+    m_faceNormals.x.clear();
+    m_faceBvh.built = false;
+    m_shownFaces.clear();
+    m_faceShown.clear();
+    m_rankFaces.clear();
+    m_frame.valid = false;
+}
+
+void ObjModel::GetBoxArray(double box[6]) const
+{
+    box[0] = m_box.xmin;
+    box[1] = m_box.xmax;
+    box[2] = m_box.ymin;
+    box[3] = m_box.ymax;
+    box[4] = m_box.zmin;
+    box[5] = m_box.zmax;
+}
+
+bool ObjModel::LoadFromCompressedFile(const std::wstring & filePath)
+{
+    CompressedMesh mesh;
+    if (!mesh.Open(filePath))
+    {
+        DebugPrint(L"[WRN] ObjModel::LoadFromCompressedFile : Not a "
+                   "compressed mesh: %s", filePath.c_str());
+        return false;
+    }
+
+    std::vector<UINT32> faceSizes;
+    std::vector<UINT32> indices;
+    if (!mesh.DecodeFaces(faceSizes, indices))
+    {
+        DebugPrint(L"[WRN] ObjModel::LoadFromCompressedFile : Damaged "
+                   "faces: %s", filePath.c_str());
+        return false;
+    }
+
+    m_filePath = filePath;
+
+    const CompressedMesh::Header &header = mesh.GetHeader();
+    m_vertices.clear();
+    // m_vertices[0] is a placeholder.
+    m_vertices.resize(header.vertexCount + 1);
+    mesh.DecodeVertices(reinterpret_cast<REAL *>(m_vertices.data() + 1));
+
+    m_faceIds.clear();
+    InvalidateDerivedData();
+    m_faces.offsets.resize(faceSizes.size() + 1);
+    for (size_t i = 0; i != faceSizes.size(); ++i)
+        m_faces.offsets[i + 1] = m_faces.offsets[i] + faceSizes[i];
+    m_faces.vertices.assign(indices.begin(), indices.end());
+    m_faces.attributes.assign(indices.size(), FaceAttributes{0, 0});
+
+    m_box.xmin = static_cast<REAL>(header.box[0]);
+    m_box.xmax = static_cast<REAL>(header.box[1]);
+    m_box.ymin = static_cast<REAL>(header.box[2]);
+    m_box.ymax = static_cast<REAL>(header.box[3]);
+    m_box.zmin = static_cast<REAL>(header.box[4]);
+    m_box.zmax = static_cast<REAL>(header.box[5]);
+
+    DebugPrint(L"[INF] Model has %d vertices, %d faces.",
+               m_vertices.size() - 1, m_faces.GetCount());
+    return true;
+}
+
+bool ObjModel::SaveCompressedFile(const std::wstring & filePath) const
+{
+    double box[6];
+    GetBoxArray(box);
+
+    std::vector<REAL> vertices;
+    vertices.reserve((m_vertices.size() - 1) * 3);
+    for (size_t i = 1; i < m_vertices.size(); ++i)
+    {
+        vertices.push_back(m_vertices[i].x);
+        vertices.push_back(m_vertices[i].y);
+        vertices.push_back(m_vertices[i].z);
+    }
+
+    std::vector<UINT32> faceSizes;
+    faceSizes.reserve(m_faces.GetCount());
+    for (size_t i = 0; i != m_faces.GetCount(); ++i)
+        faceSizes.push_back(m_faces.offsets[i + 1] - m_faces.offsets[i]);
+    std::vector<UINT32> indices(m_faces.vertices.begin(),
+                                m_faces.vertices.end());
+
+    return CompressedMesh::Write(filePath, box, vertices, faceSizes, indices);
+}
+
+double ObjModel::GetMaxQuantizationError(REAL scaleFactor,
+                                         INT32 width, INT32 height) const
+{
+    double box[6];
+    GetBoxArray(box);
+    return CompressedMesh::GetMaxScreenError(box, scaleFactor, width, height);
+}
+
+// Key of a grid cell for vertex welding. Different cells may share a key,
+// which only costs a few extra distance checks.
+static unsigned long long CellKey(long long x, long long y, long long z)
+{
+    const unsigned long long mask = (1ull << 21) - 1;
+    return (static_cast<unsigned long long>(x) & mask) << 42 |
+           (static_cast<unsigned long long>(y) & mask) << 21 |
+           (static_cast<unsigned long long>(z) & mask);
+}
+
+// Squared length of the cross product of (b - a) and (c - a), i.e. the
+// squared doubled area of triangle abc.
+static double CrossLength2(const Position3R & a, const Position3R & b,
+                           const Position3R & c)
+{
+    double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    double nx = uy * vz - uz * vy;
+    double ny = uz * vx - ux * vz;
+    double nz = ux * vy - uy * vx;
+    return nx * nx + ny * ny + nz * nz;
+}
+
+ObjModel::CleanupStats ObjModel::CleanupMesh(REAL weldTolerance)
+{
+    CleanupStats stats{0, 0, 0, 0};
+    const UINT32 vertexCount = static_cast<UINT32>(m_vertices.size());
 
-            for (auto epn = activeEdgePairs.begin();
-                 epn != activeEdgePairs.end(); )
+    double dx = m_box.xmax - m_box.xmin;
+    double dy = m_box.ymax - m_box.ymin;
+    double dz = m_box.zmax - m_box.zmin;
+    double tolerance = weldTolerance * std::sqrt(dx * dx + dy * dy + dz * dz);
+    double tolerance2 = tolerance * tolerance;
+    double cellSize = tolerance > 0 ? tolerance : 1;
+
+    // Every vertex is merged into the first earlier vertex within tolerance.
+    // Kept vertices are hashed by the grid cell (as large as the tolerance)
+    // they fall into, so only the 27 cells around a vertex are searched.
+    // m_vertices[0] is a placeholder and never merged.
+    std::vector<UINT32> weld(vertexCount, 0);
+    std::vector<UINT32> nextInCell(vertexCount, 0);  // 0 ends the chain
+    std::unordered_map<unsigned long long, UINT32> cells;
+    cells.reserve(vertexCount);
+    for (UINT32 i = 1; i < vertexCount; ++i)
+    {
+        const Position3R &p = m_vertices[i];
+        long long cx = static_cast<long long>(
+            std::floor((p.x - m_box.xmin) / cellSize));
+        long long cy = static_cast<long long>(
+            std::floor((p.y - m_box.ymin) / cellSize));
+        long long cz = static_cast<long long>(
+            std::floor((p.z - m_box.zmin) / cellSize));
+
+        UINT32 target = i;
+        for (long long x = cx - 1; x <= cx + 1; ++x)
+        for (long long y = cy - 1; y <= cy + 1; ++y)
+        for (long long z = cz - 1; z <= cz + 1; ++z)
+        {
+            auto it = cells.find(CellKey(x, y, z));
+            if (it == cells.end()) { continue; }
+            for (UINT32 k = it->second; k != 0; k = nextInCell[k])
             {
-                INT32 xl = static_cast<INT32>(std::ceil(epn->l.x));
-                INT32 xr = static_cast<INT32>(std::ceil(epn->r.x - 1.0f));
-                REAL z = epn->zl;
-                for (INT32 x = xl; x <= xr; ++x)
-                {
-                    // Ignore part of lines that go out of screen border.
-                    if (x >= width)
-                    {
-                        DebugPrint(L"[WRN] edge of plane #%d at y=%d, x=%d "
-                                   "posistion out of right boundary",
-                                   epn->planeId, y, x);
-                        // No need to update depth any more, since we are done
-                        // with this scan line.
-                        break;
-                    }
-                    else if (x < 0)
-                    {
-                        DebugPrint(L"[WRN] edge of plane #%d at y=%d, x=%d "
-                                   "posistion out of left boundary",
-                                   epn->planeId, y, x);
-                    }
-                    else if (z < depthBuffer[x])
-                    {
-                        // Update depthBuffer and frameBuffer.
-                        depthBuffer[x] = z;
-                        bool foundPlane = false;
-                        for (const auto &pl : activePlanes)
-                        {
-                            if (pl.id == epn->planeId)
-                            {
-                                frameBuffer[x] = pl.color;
-                                foundPlane = true;
-                                break;
-                            }
-                        }
-                        if (!foundPlane)
-                        {
-                            // BUG(jaege): find out why.
-                            DebugPrint(L"[ERR] Can't find plane #%d for edge "
-                                       "pair at x=%d, y=%d.",
-                                       epn->planeId, x, y);
-                        }
-                    }
-                    z += epn->dzx;
-                }
-                // Update activeEdgePairs.
-                --epn->l.diffy;
-                --epn->r.diffy;
-
-                // BUG(jaege): when the polygon is concave, below may have bugs.
-
-                // Replace finished edge/edge pairs in active EdgePairs.
-                // TODO(jaege): The following if may be optimized. If current
-                //     scan-line is the last of this plane, then we don't need
-                //     to update epn.
-                if (y - m_boundingRect.top + 1 >= 0 &&
-                    static_cast<size_t>(y - m_boundingRect.top + 1) <
-                    m_edges.size())
+                const Position3R &q = m_vertices[k];
+                double ex = p.x - q.x, ey = p.y - q.y, ez = p.z - q.z;
+                if (k < target && ex * ex + ey * ey + ez * ez <= tolerance2)
                 {
-                    if (epn->l.diffy == 0 && epn->r.diffy == 0)
-                    {
-                        std::vector<EdgeNode> edges;
-                        for (const auto &edge :
-                             m_edges[y - m_boundingRect.top + 1])
-                        {
-                            if (edge.planeId == epn->planeId)
-                            {
-                                edges.push_back(edge);
-                            }
-                        }
-                        assert(edges.size() == 2 || edges.size() == 0);
-                        if (edges.size() == 2)
-                        {
-                            FloatingPoint<REAL> lhs(edges[0].xtop),
-                                                rhs(edges[1].xtop);
-                            if (edges[0].xtop > edges[1].xtop ||
-                                lhs.AlmostEquals(rhs) &&
-                                edges[0].dx > edges[1].dx)
-                            {
-                                std::swap(edges[0], edges[1]);
-                            }
-                            epn->l.x = edges[0].xtop;
-                            epn->l.dx = edges[0].dx;
-                            epn->l.diffy = edges[0].diffy;
-                            epn->r.x = edges[1].xtop;
-                            epn->r.dx = edges[1].dx;
-                            epn->r.diffy = edges[1].diffy;
-                            // TODO(jaege): think if epn->zl need be updated.
-                        }
-                        else
-                        {
-                            epn = activeEdgePairs.erase(epn);
-                            continue;
-                        }
-                    }
-                    else if (epn->l.diffy == 0)
-                    {
-                        bool foundEdge = false;
-                        for (const auto &edge :
-                             m_edges[y - m_boundingRect.top + 1])
-                        {
-                            if (edge.planeId == epn->planeId)
-                            {
-                                epn->l.x = edge.xtop;
-                                epn->l.dx = edge.dx;
-                                epn->l.diffy = edge.diffy;
-                                foundEdge = true;
-                                break;
-                            }
-                        }
-                        if (!foundEdge)
-                        {
-                            DebugPrint(L"[ERR] Can't find left edge of plane "
-                                       "#%d at y=%d.", epn->planeId, y);
-                            epn = activeEdgePairs.erase(epn);
-                            continue;
-                        }
-                        epn->r.x += epn->r.dx;
-                    }
-                    else if (epn->r.diffy == 0)
-                    {
-                        bool foundEdge = false;
-                        for (const auto &edge :
-                             m_edges[y - m_boundingRect.top + 1])
-                        {
-                            if (edge.planeId == epn->planeId)
-                            {
-                                epn->r.x = edge.xtop;
-                                epn->r.dx = edge.dx;
-                                epn->r.diffy = edge.diffy;
-                                foundEdge = true;
-                                break;
-                            }
-                        }
-                        if (!foundEdge)
-                        {
-                            DebugPrint(L"[ERR] Can't find right edge of plane "
-                                       "#%d at y=%d.", epn->planeId, y);
-                            epn = activeEdgePairs.erase(epn);
-                            continue;
-                        }
-                        epn->l.x += epn->l.dx;
-                    }
-                    else
-                    {
-                        epn->l.x += epn->l.dx;
-                        epn->r.x += epn->r.dx;
-                    }
+                    target = k;
                 }
-                epn->zl += epn->dzx * epn->l.dx + epn->dzy;
-                ++epn;
             }
+        }
+
+        weld[i] = target;
+        if (target == i)
+        {
+            UINT32 &head = cells[CellKey(cx, cy, cz)];
+            nextInCell[i] = head;
+            head = i;
+        }
+        else
+        {
+            ++stats.weldedVertices;
+        }
+    }
+
+    // Rebuild the face table from welded vertices. canonical holds each kept
+    // face rotated to start at its smallest vertex id, so repeated faces
+    // compare equal. Faces with the opposite winding are not repeats, the
+    // color is taken from the normal and so differs between the two sides.
+    FaceTable faces;
+    faces.vertices.reserve(m_faces.vertices.size());
+    faces.attributes.reserve(m_faces.attributes.size());
+    FaceTable canonical;
+    canonical.vertices.reserve(m_faces.vertices.size());
+    std::unordered_multimap<unsigned long long, UINT32> faceHashes;
+    faceHashes.reserve(m_faces.GetCount());
+    std::vector<int> key;
+    std::vector<int> candidate;
+    std::vector<UINT32> faceIds;
 
-            // Update activePlanes.
-            for (auto it = activePlanes.begin(); it != activePlanes.end(); )
+    for (size_t f = 0; f != m_faces.GetCount(); ++f)
+    {
+        const size_t first = faces.vertices.size();
+        for (UINT32 k = m_faces.offsets[f]; k != m_faces.offsets[f + 1]; ++k)
+        {
+            int v = static_cast<int>(weld[m_faces.vertices[k]]);
+            if (faces.vertices.size() != first && faces.vertices.back() == v)
             {
-                if (--it->diffy == 0) { it = activePlanes.erase(it); }
-                else { ++it; }
+                continue;
             }
+            faces.vertices.push_back(v);
+            faces.attributes.push_back(m_faces.attributes[k]);
+        }
+        while (faces.vertices.size() - first > 1 &&
+               faces.vertices.back() == faces.vertices[first])
+        {
+            faces.vertices.pop_back();
+            faces.attributes.pop_back();
+        }
+        int *face = faces.vertices.data() + first;
+        const UINT32 size = static_cast<UINT32>(faces.vertices.size() - first);
+
+        // The plane equation is taken from the first three vertices, so
+        // start at the first corner that is not collinear.
+        UINT32 corner = 0;
+        while (size >= 3 && corner != size &&
+               CrossLength2(m_vertices[face[corner]],
+                            m_vertices[face[(corner + 1) % size]],
+                            m_vertices[face[(corner + 2) % size]]) <=
+               tolerance2 * tolerance2)
+        {
+            ++corner;
+        }
+        if (size < 3 || corner == size)
+        {
+            faces.vertices.resize(first);
+            faces.attributes.resize(first);
+            ++stats.degenerateFaces;
+            continue;
+        }
+        if (corner != 0)
+        {
+            std::rotate(faces.vertices.begin() + first,
+                        faces.vertices.begin() + first + corner,
+                        faces.vertices.end());
+            std::rotate(faces.attributes.begin() + first,
+                        faces.attributes.begin() + first + corner,
+                        faces.attributes.end());
+        }
+
+        key.clear();
+        for (UINT32 start = 0; start != size; ++start)
+        {
+            if (!key.empty() && face[start] > key[0]) { continue; }
+            candidate.assign(face + start, face + size);
+            candidate.insert(candidate.end(), face, face + start);
+            if (key.empty() || candidate < key) { key.swap(candidate); }
+        }
+        unsigned long long hash = 14695981039346656037ull;
+        for (int v : key)
+        {
+            hash = (hash ^ static_cast<UINT32>(v)) * 1099511628211ull;
         }
-        if (y >= 0) { buffer.SetRow(y, frameBuffer); }
+
+        bool duplicate = false;
+        auto range = faceHashes.equal_range(hash);
+        for (auto it = range.first; it != range.second && !duplicate; ++it)
+        {
+            const int *other = canonical.vertices.data() +
+                               canonical.offsets[it->second];
+            duplicate =
+                canonical.offsets[it->second + 1] -
+                canonical.offsets[it->second] == size &&
+                std::equal(key.begin(), key.end(), other);
+        }
+        if (duplicate)
+        {
+            faces.vertices.resize(first);
+            faces.attributes.resize(first);
+            ++stats.duplicateFaces;
+            continue;
+        }
+
+        if (!m_faceIds.empty()) { faceIds.push_back(m_faceIds[f]); }
+        faceHashes.insert({hash, static_cast<UINT32>(faces.GetCount())});
+        canonical.vertices.insert(canonical.vertices.end(),
+                                  key.begin(), key.end());
+        canonical.offsets.push_back(
+            static_cast<UINT32>(canonical.vertices.size()));
+        faces.offsets.push_back(static_cast<UINT32>(faces.vertices.size()));
     }
 
-    // For debug purpose, draw all vertices.
-    for (const auto & v : m_transformedVertices)
+    // Compact the vertices, keeping their order.
+    std::vector<UINT32> newIds(vertexCount, 0);
+    for (int v : faces.vertices)
+        newIds[v] = 1;
+    UINT32 newCount = 1;
+    for (UINT32 i = 1; i < vertexCount; ++i)
     {
-        buffer.DebugDrawPoint(std::lround(v.x), std::lround(v.y), Color::GREEN);
+        if (newIds[i] != 0)
+        {
+            newIds[i] = newCount;
+            m_vertices[newCount++] = m_vertices[i];
+        }
+        else if (weld[i] == i)
+        {
+            ++stats.unusedVertices;
+        }
+    }
+    m_vertices.resize(newCount);
+    for (int &v : faces.vertices)
+        v = static_cast<int>(newIds[v]);
+
+    m_faces = std::move(faces);
+    m_faceIds.swap(faceIds);
+    InvalidateDerivedData();
+
+    DebugPrint(L"[INF] Mesh cleanup: %d vertices welded, %d unused vertices "
+               "removed, %d degenerate and %d duplicate faces removed.",
+               stats.weldedVertices, stats.unusedVertices,
+               stats.degenerateFaces, stats.duplicateFaces);
+    DebugPrint(L"[INF] Model has %d vertices, %d faces.",
+               m_vertices.size() - 1, m_faces.GetCount());
+    return stats;
+}
+
+// Spread the lower 10 bits of n to every third bit.
+static UINT32 SpreadBits(UINT32 n)
+{
+    n &= 0x3ff;
+    n = (n | n << 16) & 0x030000ff;
+    n = (n | n << 8) & 0x0300f00f;
+    n = (n | n << 4) & 0x030c30c3;
+    n = (n | n << 2) & 0x09249249;
+    return n;
+}
+
+void ObjModel::ReorderForLocality()
+{
+    const size_t faceCount = m_faces.GetCount();
+    const UINT32 vertexCount = static_cast<UINT32>(m_vertices.size());
+
+    // Sort keys: Z-order code of the centroid on a 1024^3 grid over the
+    // bounding box in the upper half, face id in the lower half, so equal
+    // codes keep their order.
+    const double lower[3] = {m_box.xmin, m_box.ymin, m_box.zmin};
+    const double extent[3] = {m_box.xmax - m_box.xmin,
+                              m_box.ymax - m_box.ymin,
+                              m_box.zmax - m_box.zmin};
+    std::vector<unsigned long long> keys(faceCount);
+    for (size_t f = 0; f != faceCount; ++f)
+    {
+        double centroid[3] = {0, 0, 0};
+        for (UINT32 k = m_faces.offsets[f]; k != m_faces.offsets[f + 1]; ++k)
+        {
+            const Position3R &p = m_vertices[m_faces.vertices[k]];
+            centroid[0] += p.x;
+            centroid[1] += p.y;
+            centroid[2] += p.z;
+        }
+        UINT32 size = m_faces.offsets[f + 1] - m_faces.offsets[f];
+        UINT32 code = 0;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            double t = extent[axis] > 0 ?
+                (centroid[axis] / size - lower[axis]) / extent[axis] : 0;
+            UINT32 cell = t <= 0 ? 0 : t >= 1 ? 1023 :
+                static_cast<UINT32>(t * 1023);
+            code |= SpreadBits(cell) << axis;
+        }
+        keys[f] = static_cast<unsigned long long>(code) << 32 | f;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    FaceTable faces;
+    faces.offsets.reserve(faceCount + 1);
+    faces.vertices.reserve(m_faces.vertices.size());
+    faces.attributes.reserve(m_faces.attributes.size());
+    std::vector<UINT32> faceIds;
+    faceIds.reserve(faceCount);
+    for (unsigned long long key : keys)
+    {
+        UINT32 f = static_cast<UINT32>(key);
+        faceIds.push_back(m_faceIds.empty() ? f : m_faceIds[f]);
+        UINT32 begin = m_faces.offsets[f];
+        UINT32 end = m_faces.offsets[f + 1];
+        faces.vertices.insert(faces.vertices.end(),
+                              m_faces.vertices.begin() + begin,
+                              m_faces.vertices.begin() + end);
+        faces.attributes.insert(faces.attributes.end(),
+                                m_faces.attributes.begin() + begin,
+                                m_faces.attributes.begin() + end);
+        faces.offsets.push_back(static_cast<UINT32>(faces.vertices.size()));
+    }
+
+    // Number vertices by first use. Vertices no face refers to keep their
+    // relative order at the end, they still count for the bounding
+    // rectangle. m_vertices[0] is a placeholder and stays in place.
+    std::vector<UINT32> newIds(vertexCount, 0);
+    std::vector<Position3R> vertices;
+    vertices.reserve(vertexCount);
+    vertices.push_back(m_vertices[0]);
+    for (int &v : faces.vertices)
+    {
+        if (v != 0 && newIds[v] == 0)
+        {
+            newIds[v] = static_cast<UINT32>(vertices.size());
+            vertices.push_back(m_vertices[v]);
+        }
+        v = static_cast<int>(newIds[v]);
+    }
+    for (UINT32 i = 1; i < vertexCount; ++i)
+    {
+        if (newIds[i] == 0) { vertices.push_back(m_vertices[i]); }
+    }
+
+    m_vertices.swap(vertices);
+    m_faces = std::move(faces);
+    m_faceIds.swap(faceIds);
+    InvalidateDerivedData();
+}
+
+void ObjModel::TransformModel(INT32 width, INT32 height, REAL scaleFactor,
+                              REAL degreeX, REAL degreeY,
+                              REAL shiftX, REAL shiftY, const RECT & area)
+{
+    assert(scaleFactor > 0);
+    REAL xScale = width / (m_box.xmax - m_box.xmin);
+    REAL yScale = height / (m_box.ymax - m_box.ymin);
+
+    // Ensure that the whole object can be seen in screen when scaleFactor <= 1.
+    REAL scale = min(xScale, yScale) * scaleFactor;
+
+    // The matrices are mulitplied in reverse order, i.e. last tranformation comes first.
+    Affine3x4R transform =
+        Transformation::Translate(width / 2.0f + shiftX, height / 2.0f + shiftY, 0) *
+        Transformation::Scale(scale) *
+        Transformation::RotateAboutXAxis(degreeX) *
+        Transformation::RotateAboutYAxis(degreeY) *
+        Transformation::Symmetry(true, false, true) *
+        Transformation::Translate(-(m_box.xmin + m_box.xmax) / 2,
+                                  -(m_box.ymin + m_box.ymax) / 2,
+                                  -(m_box.zmin + m_box.zmax) / 2);
+
+    // Normals only turn with the model. Symmetry() flips two axes, which
+    // is a rotation too, so the face normals keep their side.
+    Affine3x4R rotation =
+        Transformation::RotateAboutXAxis(degreeX) *
+        Transformation::RotateAboutYAxis(degreeY) *
+        Transformation::Symmetry(true, false, true);
+    if (m_faceNormals.x.size() != m_faces.GetCount()) { InitFaceNormals(); }
+    m_transformedNormals.resize(m_faces.GetCount());
+
+    m_transformedVertices.resize(m_vertices.size());
+    if (!m_faceBvh.built) { InitFaceBvh(); }
+
+    VertexTransform::Bounds bounds;
+    if (m_faceBvh.nodes.empty() ||
+        !TransformVisibleFaces(transform, rotation, area, bounds))
+    {
+        VertexTransform::Transform(rotation, m_faceNormals.x.data(),
+                                   m_faceNormals.y.data(),
+                                   m_faceNormals.z.data(), m_faces.GetCount(),
+                                   m_transformedNormals.data());
+
+        if (m_vertexArrays.x.size() != m_vertices.size())
+        {
+            m_vertexArrays.x.resize(m_vertices.size());
+            m_vertexArrays.y.resize(m_vertices.size());
+            m_vertexArrays.z.resize(m_vertices.size());
+            for (size_t i = 0; i != m_vertices.size(); ++i)
+            {
+                m_vertexArrays.x[i] = m_vertices[i].x;
+                m_vertexArrays.y[i] = m_vertices[i].y;
+                m_vertexArrays.z[i] = m_vertices[i].z;
+            }
+        }
+
+        bounds = VertexTransform::Transform(
+            transform, m_vertexArrays.x.data(), m_vertexArrays.y.data(),
+            m_vertexArrays.z.data(), m_vertices.size(),
+            m_transformedVertices.data());
+
+        const UINT32 faceCount = static_cast<UINT32>(m_faces.GetCount());
+        if (!m_allFacesVisible || m_facesInView.size() != faceCount)
+        {
+            m_facesInView.resize(faceCount);
+            for (UINT32 pid = 0; pid != faceCount; ++pid)
+                m_facesInView[pid] = pid;
+        }
+        m_allFacesVisible = true;
+        m_vertexRuns.clear();
+    }
+    REAL left = bounds.left;
+    REAL right = bounds.right;
+    REAL top = bounds.top;
+    REAL bottom = bounds.bottom;
+
+    // Round inside the bounding rectangle.
+    m_boundingRect.left = static_cast<LONG>(std::ceil(left));  // xmin'
+    m_boundingRect.right = static_cast<LONG>(std::floor(right));  // xmax'
+    m_boundingRect.top = static_cast<LONG>(std::ceil(top));  // ymin'
+    m_boundingRect.bottom = static_cast<LONG>(std::floor(bottom));  // ymax'
+}
+
+void ObjModel::InitFaceNormals()
+{
+    const size_t faceCount = m_faces.GetCount();
+    m_faceNormals.x.resize(faceCount);
+    m_faceNormals.y.resize(faceCount);
+    m_faceNormals.z.resize(faceCount);
+    for (size_t pid = 0; pid != faceCount; ++pid)
+    {
+        const int *face = m_faces.vertices.data() + m_faces.offsets[pid];
+        const Position3R &p1 = m_vertices[face[0]];
+        const Position3R &p2 = m_vertices[face[1]];
+        const Position3R &p3 = m_vertices[face[2]];
+        REAL a = (p2.y - p1.y) * (p3.z - p1.z) - (p3.y - p1.y) * (p2.z - p1.z);
+        REAL b = (p3.x - p1.x) * (p2.z - p1.z) - (p2.x - p1.x) * (p3.z - p1.z);
+        REAL c = (p2.x - p1.x) * (p3.y - p1.y) - (p3.x - p1.x) * (p2.y - p1.y);
+        REAL n = std::sqrt(a * a + b * b + c * c);
+        if (n == 0) { n = 1; }
+        m_faceNormals.x[pid] = a / n;
+        m_faceNormals.y[pid] = b / n;
+        m_faceNormals.z[pid] = c / n;
+    }
+}
+
+bool ObjModel::TransformVisibleFaces(const Affine3x4R & transform,
+                                     const Affine3x4R & rotation,
+                                     const RECT & area,
+                                     VertexTransform::Bounds & bounds)
+{
+    REAL absolute[2][3];
+    for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 3; ++j)
+            absolute[i][j] = std::fabs(transform.m[i][j]);
+
+    // Nodes whose screen bounds miss area by more than a pixel are
+    // dropped. The bounds of a node are those of its transformed box.
+    m_facesInView.clear();
+    m_vertexRuns.clear();
+    m_faceRuns.clear();
+    const auto &nodes = m_faceBvh.nodes;
+    for (UINT32 i = 0; i != nodes.size(); )
+    {
+        const FaceBvh::Node &node = nodes[i];
+        Position3R center = transform * node.center;
+        REAL xextent = absolute[0][0] * node.extent.x +
+                       absolute[0][1] * node.extent.y +
+                       absolute[0][2] * node.extent.z;
+        REAL yextent = absolute[1][0] * node.extent.x +
+                       absolute[1][1] * node.extent.y +
+                       absolute[1][2] * node.extent.z;
+        REAL left = center.x - xextent;
+        REAL right = center.x + xextent;
+        REAL top = center.y - yextent;
+        REAL bottom = center.y + yextent;
+
+        if (right < area.left - 1 || left > area.right ||
+            bottom < area.top - 1 || top > area.bottom)
+        {
+            if (left < bounds.left) bounds.left = left;
+            if (right > bounds.right) bounds.right = right;
+            if (top < bounds.top) bounds.top = top;
+            if (bottom > bounds.bottom) bounds.bottom = bottom;
+            i = node.skip;
+            continue;
+        }
+
+        bool inside = left >= area.left && right <= area.right - 1 &&
+                      top >= area.top && bottom <= area.bottom - 1;
+        if (i == 0 && inside) { return false; }
+        if (!inside && node.skip != i + 1)
+        {
+            ++i;
+            continue;
+        }
+
+        m_facesInView.insert(m_facesInView.end(),
+                             m_faceBvh.faces.begin() + node.faceBegin,
+                             m_faceBvh.faces.begin() + node.faceEnd);
+        if (!m_vertexRuns.empty() &&
+            m_vertexRuns.back().end == node.vertexBegin)
+        {
+            m_vertexRuns.back().end = node.vertexEnd;
+        }
+        else
+        {
+            m_vertexRuns.push_back({node.vertexBegin, node.vertexEnd});
+        }
+        if (!m_faceRuns.empty() && m_faceRuns.back().end == node.faceBegin)
+        {
+            m_faceRuns.back().end = node.faceEnd;
+        }
+        else
+        {
+            m_faceRuns.push_back({node.faceBegin, node.faceEnd});
+        }
+        i = node.skip;
+    }
+    m_allFacesVisible = false;
+
+    // A vertex in several leaves is transformed for each of them, always
+    // to the same position.
+    const VertexArrays &vertices = m_faceBvh.vertices;
+    for (const Range &run : m_vertexRuns)
+    {
+        VertexTransform::Bounds runBounds = VertexTransform::Transform(
+            transform, vertices.x.data() + run.begin,
+            vertices.y.data() + run.begin, vertices.z.data() + run.begin,
+            run.end - run.begin, m_runVertices.data() + run.begin);
+        if (runBounds.left < bounds.left) bounds.left = runBounds.left;
+        if (runBounds.right > bounds.right) bounds.right = runBounds.right;
+        if (runBounds.top < bounds.top) bounds.top = runBounds.top;
+        if (runBounds.bottom > bounds.bottom) bounds.bottom = runBounds.bottom;
+
+        for (UINT32 k = run.begin; k != run.end; ++k)
+        {
+            m_transformedVertices[m_faceBvh.vertexIds[k]] = m_runVertices[k];
+        }
+    }
+
+    const VertexArrays &normals = m_faceBvh.normals;
+    for (const Range &run : m_faceRuns)
+    {
+        VertexTransform::Transform(
+            rotation, normals.x.data() + run.begin,
+            normals.y.data() + run.begin, normals.z.data() + run.begin,
+            run.end - run.begin, m_runNormals.data() + run.begin);
+        for (UINT32 k = run.begin; k != run.end; ++k)
+            m_transformedNormals[m_faceBvh.faces[k]] = m_runNormals[k];
+    }
+    return true;
+}
+
+void ObjModel::InitFaceBvh()
+{
+    m_faceBvh = FaceBvh();
+    m_faceBvh.built = true;
+    const UINT32 faceCount = static_cast<UINT32>(m_faces.GetCount());
+    if (faceCount < BVH_MIN_FACES) { return; }
+
+    // Faces are split at the median of the centers of their boxes.
+    std::vector<Position3R> centers(faceCount);
+    for (UINT32 pid = 0; pid != faceCount; ++pid)
+    {
+        Position3R lower{REAL_MAX, REAL_MAX, REAL_MAX};
+        Position3R upper{-REAL_MAX, -REAL_MAX, -REAL_MAX};
+        for (UINT32 k = m_faces.offsets[pid]; k != m_faces.offsets[pid + 1];
+             ++k)
+        {
+            const Position3R &p = m_vertices[m_faces.vertices[k]];
+            if (lower.x > p.x) lower.x = p.x;
+            if (lower.y > p.y) lower.y = p.y;
+            if (lower.z > p.z) lower.z = p.z;
+            if (upper.x < p.x) upper.x = p.x;
+            if (upper.y < p.y) upper.y = p.y;
+            if (upper.z < p.z) upper.z = p.z;
+        }
+        centers[pid] = {(lower.x + upper.x) / 2, (lower.y + upper.y) / 2,
+                        (lower.z + upper.z) / 2};
+    }
+
+    m_faceBvh.faces.resize(faceCount);
+    for (UINT32 pid = 0; pid != faceCount; ++pid)
+        m_faceBvh.faces[pid] = pid;
+    std::vector<UINT32> leafOfVertex(m_vertices.size(), 0);
+    BuildFaceBvh(0, faceCount, centers, leafOfVertex);
+
+    VertexArrays &vertices = m_faceBvh.vertices;
+    const size_t count = m_faceBvh.vertexIds.size();
+    vertices.x.resize(count);
+    vertices.y.resize(count);
+    vertices.z.resize(count);
+    for (size_t k = 0; k != count; ++k)
+    {
+        const Position3R &p = m_vertices[m_faceBvh.vertexIds[k]];
+        vertices.x[k] = p.x;
+        vertices.y[k] = p.y;
+        vertices.z[k] = p.z;
+    }
+
+    // m_faceNormals is set up before the index.
+    VertexArrays &normals = m_faceBvh.normals;
+    normals.x.resize(faceCount);
+    normals.y.resize(faceCount);
+    normals.z.resize(faceCount);
+    for (UINT32 k = 0; k != faceCount; ++k)
+    {
+        const UINT32 pid = m_faceBvh.faces[k];
+        normals.x[k] = m_faceNormals.x[pid];
+        normals.y[k] = m_faceNormals.y[pid];
+        normals.z[k] = m_faceNormals.z[pid];
+    }
+
+    // TransformVisibleFaces() takes at most every leaf.
+    m_facesInView.reserve(faceCount);
+    m_vertexRuns.reserve(m_faceBvh.nodes.size());
+    m_faceRuns.reserve(m_faceBvh.nodes.size());
+    m_runVertices.resize(count);
+    m_runNormals.resize(faceCount);
+
+    DebugPrint(L"[INF] Face index has %d nodes, %d leaf vertices.",
+               m_faceBvh.nodes.size(), count);
+}
+
+void ObjModel::BuildFaceBvh(UINT32 begin, UINT32 end,
+                            const std::vector<Position3R> & centers,
+                            std::vector<UINT32> & leafOfVertex)
+{
+    auto &nodes = m_faceBvh.nodes;
+    const UINT32 index = static_cast<UINT32>(nodes.size());
+    nodes.push_back(FaceBvh::Node());
+
+    Position3R lower{REAL_MAX, REAL_MAX, REAL_MAX};
+    Position3R upper{-REAL_MAX, -REAL_MAX, -REAL_MAX};
+    if (end - begin <= BVH_LEAF_FACES)
+    {
+        // leafOfVertex marks the vertices already listed for this leaf.
+        const UINT32 vertexBegin =
+            static_cast<UINT32>(m_faceBvh.vertexIds.size());
+        for (UINT32 f = begin; f != end; ++f)
+        {
+            const UINT32 pid = m_faceBvh.faces[f];
+            for (UINT32 k = m_faces.offsets[pid];
+                 k != m_faces.offsets[pid + 1]; ++k)
+            {
+                const int vid = m_faces.vertices[k];
+                if (leafOfVertex[vid] == index + 1) { continue; }
+                leafOfVertex[vid] = index + 1;
+                m_faceBvh.vertexIds.push_back(vid);
+
+                const Position3R &p = m_vertices[vid];
+                if (lower.x > p.x) lower.x = p.x;
+                if (lower.y > p.y) lower.y = p.y;
+                if (lower.z > p.z) lower.z = p.z;
+                if (upper.x < p.x) upper.x = p.x;
+                if (upper.y < p.y) upper.y = p.y;
+                if (upper.z < p.z) upper.z = p.z;
+            }
+        }
+        nodes[index].vertexBegin = vertexBegin;
+    }
+    else
+    {
+        // Split along the longest side of the box of the centers.
+        Position3R clower{REAL_MAX, REAL_MAX, REAL_MAX};
+        Position3R cupper{-REAL_MAX, -REAL_MAX, -REAL_MAX};
+        for (UINT32 f = begin; f != end; ++f)
+        {
+            const Position3R &c = centers[m_faceBvh.faces[f]];
+            if (clower.x > c.x) clower.x = c.x;
+            if (clower.y > c.y) clower.y = c.y;
+            if (clower.z > c.z) clower.z = c.z;
+            if (cupper.x < c.x) cupper.x = c.x;
+            if (cupper.y < c.y) cupper.y = c.y;
+            if (cupper.z < c.z) cupper.z = c.z;
+        }
+        REAL sizeX = cupper.x - clower.x;
+        REAL sizeY = cupper.y - clower.y;
+        REAL sizeZ = cupper.z - clower.z;
+        const int axis = sizeX >= sizeY && sizeX >= sizeZ ? 0 :
+                         sizeY >= sizeZ ? 1 : 2;
+
+        const UINT32 middle = begin + (end - begin) / 2;
+        std::nth_element(m_faceBvh.faces.begin() + begin,
+                         m_faceBvh.faces.begin() + middle,
+                         m_faceBvh.faces.begin() + end,
+                         [&centers, axis](UINT32 lhs, UINT32 rhs)
+        {
+            const Position3R &l = centers[lhs];
+            const Position3R &r = centers[rhs];
+            return axis == 0 ? l.x < r.x : axis == 1 ? l.y < r.y : l.z < r.z;
+        });
+
+        BuildFaceBvh(begin, middle, centers, leafOfVertex);
+        BuildFaceBvh(middle, end, centers, leafOfVertex);
+
+        // The box of a node is the box of its two children.
+        for (UINT32 child = index + 1; child != nodes.size();
+             child = nodes[child].skip)
+        {
+            const FaceBvh::Node &node = nodes[child];
+            Position3R l{node.center.x - node.extent.x,
+                         node.center.y - node.extent.y,
+                         node.center.z - node.extent.z};
+            Position3R u{node.center.x + node.extent.x,
+                         node.center.y + node.extent.y,
+                         node.center.z + node.extent.z};
+            if (lower.x > l.x) lower.x = l.x;
+            if (lower.y > l.y) lower.y = l.y;
+            if (lower.z > l.z) lower.z = l.z;
+            if (upper.x < u.x) upper.x = u.x;
+            if (upper.y < u.y) upper.y = u.y;
+            if (upper.z < u.z) upper.z = u.z;
+        }
+        nodes[index].vertexBegin = nodes[index + 1].vertexBegin;
+    }
+
+    FaceBvh::Node &node = nodes[index];
+    node.center = {(lower.x + upper.x) / 2, (lower.y + upper.y) / 2,
+                   (lower.z + upper.z) / 2};
+    node.extent = {(upper.x - lower.x) / 2, (upper.y - lower.y) / 2,
+                   (upper.z - lower.z) / 2};
+    node.skip = static_cast<UINT32>(nodes.size());
+    node.faceBegin = begin;
+    node.faceEnd = end;
+    node.vertexEnd = static_cast<UINT32>(m_faceBvh.vertexIds.size());
+}
+
+void ObjModel::InitEdgeAdjacency()
+{
+    m_meshEdges.clear();
+    m_faceEdges.resize(m_faces.vertices.size());
+    m_tableBounds = TableBounds{0, 0, 0, 0, 0};
+
+    // Key of an undirected edge: the smaller vertex id in the upper half.
+    std::unordered_map<unsigned long long, UINT32> edgeIds;
+    edgeIds.reserve(m_faces.vertices.size());
+    for (size_t f = 0; f != m_faces.GetCount(); ++f)
+    {
+        const UINT32 begin = m_faces.offsets[f];
+        const UINT32 end = m_faces.offsets[f + 1];
+        const UINT32 faceSize = end - begin;
+        const bool convex = faceSize == 3 ||
+                            IsConvexFace(static_cast<UINT32>(f));
+        const UINT32 planes = convex ? 1 : (3 * faceSize + 1) / 2;
+        const UINT32 chains = convex ? faceSize : 2 * planes + faceSize;
+        TableBounds &bounds = m_tableBounds;
+        bounds.planes += planes;
+        bounds.chains += chains;
+        if (bounds.facePlanes < planes) bounds.facePlanes = planes;
+        if (bounds.faceChains < chains) bounds.faceChains = chains;
+        if (bounds.faceSize < faceSize) bounds.faceSize = faceSize;
+        for (UINT32 k = begin; k != end; ++k)
+        {
+            // The last edge goes from the last vertex back to the first one.
+            int v1 = m_faces.vertices[k];
+            int v2 = m_faces.vertices[k + 1 != end ? k + 1 : begin];
+            unsigned long long key = v1 < v2 ?
+                static_cast<unsigned long long>(v1) << 32 | v2 :
+                static_cast<unsigned long long>(v2) << 32 | v1;
+            auto result = edgeIds.insert(
+                {key, static_cast<UINT32>(m_meshEdges.size())});
+            if (result.second) { m_meshEdges.push_back({v1, v2}); }
+            m_faceEdges[k] = result.first->second;
+        }
+    }
+
+    DebugPrint(L"[INF] Model has %d edges, %d face edges.",
+               m_meshEdges.size(), m_faceEdges.size());
+}
+
+bool ObjModel::IsConvexFace(UINT32 pid) const
+{
+    const int *face = m_faces.vertices.data() + m_faces.offsets[pid];
+    const UINT32 faceSize = m_faces.offsets[pid + 1] - m_faces.offsets[pid];
+
+    // Newell's normal, whose length is twice the area of the face.
+    REAL nx = 0;
+    REAL ny = 0;
+    REAL nz = 0;
+    for (UINT32 i = 0; i != faceSize; ++i)
+    {
+        const Position3R &p = m_vertices[face[i]];
+        const Position3R &q = m_vertices[face[(i + 1) % faceSize]];
+        nx += (p.y - q.y) * (p.z + q.z);
+        ny += (p.z - q.z) * (p.x + q.x);
+        nz += (p.x - q.x) * (p.y + q.y);
+    }
+    REAL n = std::sqrt(nx * nx + ny * ny + nz * nz);
+    if (n == 0) { return false; }
+    const REAL flatness = 1e-3f * std::sqrt(n);
+    nx /= n;
+    ny /= n;
+    nz /= n;
+
+    // The face is flat, turns the same way at every vertex and goes round
+    // once, a star goes round at least twice.
+    constexpr REAL PI = 3.14159265358979323846f;
+    const Position3R &p0 = m_vertices[face[0]];
+    REAL turn = 0;
+    for (UINT32 i = 0; i != faceSize; ++i)
+    {
+        const Position3R &a = m_vertices[face[(i + faceSize - 1) % faceSize]];
+        const Position3R &b = m_vertices[face[i]];
+        const Position3R &c = m_vertices[face[(i + 1) % faceSize]];
+        if (std::fabs((b.x - p0.x) * nx + (b.y - p0.y) * ny +
+                      (b.z - p0.z) * nz) > flatness)
+        {
+            return false;
+        }
+        REAL x1 = b.x - a.x, y1 = b.y - a.y, z1 = b.z - a.z;
+        REAL x2 = c.x - b.x, y2 = c.y - b.y, z2 = c.z - b.z;
+        REAL sine = (y1 * z2 - z1 * y2) * nx + (z1 * x2 - x1 * z2) * ny +
+                    (x1 * y2 - y1 * x2) * nz;
+        if (sine <= 0) { return false; }
+        turn += std::atan2(sine, x1 * x2 + y1 * y2 + z1 * z2);
+    }
+    return turn < 3 * PI;
+}
+
+void ObjModel::InitEdge(size_t eid)
+{
+    const auto *ptop = &m_transformedVertices[m_meshEdges[eid].v1];
+    const auto *pbtm = &m_transformedVertices[m_meshEdges[eid].v2];
+
+    if (ptop->y > pbtm->y)
+    {
+        auto p = ptop;
+        ptop = pbtm;
+        pbtm = p;
+        //std::swap(ptop, pbtm);
+    }
+
+    INT32 ptopyi = static_cast<INT32>(std::floor(ptop->y + 1.0f));
+    INT32 pbtmyi = static_cast<INT32>(std::floor(pbtm->y));
+
+    // Clip the edge to the rows of the tables.
+    if (ptopyi < m_tableRect.top) ptopyi = m_tableRect.top;
+    if (pbtmyi > m_tableRect.bottom) pbtmyi = m_tableRect.bottom;
+
+    EdgeNode &edge = m_edges[eid];
+    edge.topyi = ptopyi;
+
+    // Ignore horizontal edges that stay between two adjcent scan-lines.
+    // Some edges may not parallel to x axis, but their projections on
+    // y axis is so small that not intersect with any scan-lines. They
+    // should also be omited. pbtmyi is ptopyi - 1 then.
+    // NOTE(jaege): When ptopyi==pbtmyi, the edge is still need to add
+    //     to the edge tables, because it intersectes with scan-line.
+    if (ptopyi > pbtmyi)
+    {
+        edge.diffy = 0;
+        return;
+    }
+
+    edge.dx = (ptop->x - pbtm->x) / (ptop->y - pbtm->y);
+    edge.xtop = ptop->x - edge.dx * (ptop->y - ptopyi);
+    edge.diffy = pbtmyi - ptopyi + 1;
+}
+
+void ObjModel::InitPlane(UINT32 pid, bool clipColumns, REAL lightN,
+                         TablePart & part) const
+{
+    PlaneNode pn;
+    // face[i] is vertex id, there are faceSize of them.
+    const int *face = m_faces.vertices.data() + m_faces.offsets[pid];
+    const UINT32 faceSize = m_faces.offsets[pid + 1] -
+                            m_faces.offsets[pid];
+
+    // Always use first 3 vertices to calculate the plane equation. The
+    // normal is theirs, turned with the model.
+    const Position3R &normal = m_transformedNormals[pid];
+    const Position3R &p1 = m_transformedVertices[face[0]];
+    pn.plane = {normal.x, normal.y, normal.z,
+                -(p1.x * normal.x + p1.y * normal.y + p1.z * normal.z)};
+    // NOTE(jaege): Only plane face is supported, all vertices must in the
+    //     same plane. The planse is assured to have at least 3 vertices.
+    // BUG(jaege): check why assert fail when it shouldn't.
+    //for (UINT32 vid = 3; vid != faceSize; ++vid)
+    //{
+    //    const auto &p = m_transformedVertices[face[vid]];
+    //    FloatingPoint<REAL> lhs(p.x * pn.plane.a + p.y * pn.plane.b +
+    //                            p.z * pn.plane.c + pn.plane.d), rhs(0.0f);
+    //    assert(lhs.AlmostEquals(rhs));
+    //}
+
+    // Ignore planes that parallel to z axis.
+    FloatingPoint<REAL> lhs(pn.plane.c), rhs(0.0f);
+    if (lhs.AlmostEquals(rhs)) { return; }
+
+    pn.id = pid;
+
+    REAL xmin = REAL_MAX;
+    REAL xmax = -REAL_MAX;
+    pn.zmin = REAL_MAX;
+    for (UINT32 vid = 0; vid != faceSize; ++vid)
+    {
+        const auto &p = m_transformedVertices[face[vid]];
+        if (xmin > p.x) xmin = p.x;
+        if (xmax < p.x) xmax = p.x;
+        if (pn.zmin > p.z) pn.zmin = p.z;
+    }
+
+    // Faces left or right of the tables are not drawn. A margin of a
+    // pixel covers the rounding of the edges.
+    if (clipColumns &&
+        (xmax < m_tableRect.left - 1 || xmin > m_tableRect.right + 1))
+    {
+        return;
+    }
+
+    INT32 topyi = m_tableRect.bottom + 1;
+    INT32 btmyi = m_tableRect.top - 1;
+    const UINT32 *faceEdges = m_faceEdges.data() + m_faces.offsets[pid];
+    for (UINT32 vid = 0; vid != faceSize; ++vid)
+    {
+        const EdgeNode &edge = m_edges[faceEdges[vid]];
+        // Edges crossing no scan-line of the tables do not count.
+        if (edge.diffy == 0) { continue; }
+        INT32 ptopyi = edge.topyi;
+        INT32 pbtmyi = edge.topyi + static_cast<INT32>(edge.diffy) - 1;
+
+        if (topyi > ptopyi) topyi = ptopyi;
+        if (btmyi < pbtmyi) btmyi = pbtmyi;
+    }
+
+    // Some planes may not parallel to z axis, but their projections on
+    // y axis is so small that not intersect with any scan-lines. They
+    // should also be ignored, as the planes out of the tables' rows.
+    if (btmyi < topyi) { return; }
+    pn.diffy = btmyi - topyi + 1;
+
+    // Calculate color from the angle of face normal n, which is
+    // n(a, b, c), and the light direction normal l(i, j, k). The smaller
+    // the angle is, the light the color is.
+    //
+    //     n(a, b, c) dot l(i, j, k) = |n|*|l|*cos(theta)
+
+    REAL costheta = (pn.plane.a * m_light.x + pn.plane.b * m_light.y +
+                     pn.plane.c * m_light.z) * lightN;
+    costheta = 0.5f - costheta / 2;
+
+    pn.color.red = static_cast<UINT8>(std::round(m_planeColor.red * costheta));
+    pn.color.green = static_cast<UINT8>(std::round(m_planeColor.green * costheta));
+    pn.color.blue = static_cast<UINT8>(std::round(m_planeColor.blue * costheta));
+    AddEdgePairs(pn, topyi, btmyi, part);
+}
+
+void ObjModel::AddEdgePairs(const PlaneNode & pn, INT32 topyi, INT32 btmyi,
+                            TablePart & part) const
+{
+    // Edges of the face that cross a scan-line, in the order of their
+    // first scan-lines, and otherwise in the order of the face. Below,
+    // edges are their index in part.edges.
+    auto &edges = part.edges;
+    edges.clear();
+    for (UINT32 k = m_faces.offsets[pn.id]; k != m_faces.offsets[pn.id + 1];
+         ++k)
+    {
+        const EdgeNode &edge = m_edges[m_faceEdges[k]];
+        if (edge.diffy == 0) { continue; }
+        edges.push_back(edge);
+        for (size_t i = edges.size() - 1;
+             i != 0 && edges[i - 1].topyi > edges[i].topyi; --i)
+        {
+            std::swap(edges[i - 1], edges[i]);
+        }
+    }
+
+    auto endOf = [&](UINT32 e)
+    {
+        return edges[e].topyi + static_cast<INT32>(edges[e].diffy);
+    };
+    auto xOf = [&](UINT32 e, INT32 y)
+    {
+        return y == edges[e].topyi ? edges[e].xtop :
+               edges[e].xtop + edges[e].dx * (y - edges[e].topyi);
+    };
+    // Whether edge e1 is right of edge e2 at scan-line y.
+    auto isRightOf = [&](UINT32 e1, UINT32 e2, INT32 y)
+    {
+        const REAL x1 = xOf(e1, y);
+        const REAL x2 = xOf(e2, y);
+        FloatingPoint<REAL> lhs(x1), rhs(x2);
+        return x1 > x2 ||
+               lhs.AlmostEquals(rhs) && edges[e1].dx > edges[e2].dx;
+    };
+    // Node of the part of edge e from scan-line y down.
+    auto addNode = [&](UINT32 e, INT32 y)
+    {
+        part.chains.push_back(EdgeChainNode{
+            xOf(e, y), edges[e].dx, static_cast<UINT32>(endOf(e) - y),
+            NO_EDGE});
+        return static_cast<UINT32>(part.chains.size() - 1);
+    };
+    // Add the node of edge e from scan-line y below node last.
+    auto linkNode = [&](UINT32 & last, UINT32 e, INT32 y)
+    {
+        const UINT32 node = addNode(e, y);
+        part.chains[last].next = node;
+        last = node;
+    };
+    auto addPlane = [&](INT32 y, UINT32 left, UINT32 right, UINT32 diffy)
+    {
+        part.planes.push_back(pn);
+        part.planes.back().left = left;
+        part.planes.back().right = right;
+        part.planes.back().diffy = diffy;
+        part.rows.push_back(y - m_tableRect.top);
+        ++part.rowCounts[y - m_tableRect.top];
+    };
+
+    // Most faces have one pair from top to bottom. Two edges start it,
+    // and every other edge starts alone where one side ends, or two of
+    // them start where both sides end.
+    const UINT32 edgeCount = static_cast<UINT32>(edges.size());
+    const size_t chainCount = part.chains.size();
+    auto startsAt = [&](UINT32 e, INT32 y)
+    {
+        return e < edgeCount && edges[e].topyi == y;
+    };
+    if (startsAt(0, topyi) && startsAt(1, topyi) && !startsAt(2, topyi))
+    {
+        UINT32 l = 0;
+        UINT32 r = 1;
+        if (isRightOf(l, r, topyi)) { std::swap(l, r); }
+        const UINT32 left = addNode(l, topyi);
+        const UINT32 right = addNode(r, topyi);
+        UINT32 lnode = left;
+        UINT32 rnode = right;
+        INT32 lend = endOf(l);
+        INT32 rend = endOf(r);
+        UINT32 e = 2;
+        for (; e != edgeCount; ++e)
+        {
+            const INT32 y = edges[e].topyi;
+            if (lend == y && rend == y)
+            {
+                if (!startsAt(e + 1, y) || startsAt(e + 2, y)) { break; }
+                l = e;
+                r = ++e;
+                if (isRightOf(l, r, y)) { std::swap(l, r); }
+                linkNode(lnode, l, y);
+                linkNode(rnode, r, y);
+                lend = endOf(l);
+                rend = endOf(r);
+            }
+            else if ((lend == y || rend == y) && !startsAt(e + 1, y))
+            {
+                linkNode(lend == y ? lnode : rnode, e, y);
+                (lend == y ? lend : rend) = endOf(e);
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (e == edgeCount && lend == btmyi + 1 && rend == btmyi + 1)
+        {
+            addPlane(topyi, left, right, btmyi - topyi + 1);
+            return;
+        }
+        part.chains.resize(chainCount);
+    }
+
+    // Otherwise the edges are sorted by x and paired from the left at
+    // every scan-line where one starts or ends. A pair goes on below such
+    // a scan-line if each of its sides keeps its edge or takes the one
+    // starting where it ends. The other pairs end there, and the edges
+    // left start new ones.
+    part.events.clear();
+    for (UINT32 e = 0; e != edgeCount; ++e)
+    {
+        part.events.push_back(edges[e].topyi);
+        part.events.push_back(endOf(e));
+    }
+    std::sort(part.events.begin(), part.events.end());
+    part.events.erase(std::unique(part.events.begin(), part.events.end()),
+                      part.events.end());
+
+    auto continues = [&](UINT32 from, UINT32 to, INT32 y)
+    {
+        return from == to || endOf(from) == y && edges[to].topyi == y;
+    };
+    part.open.clear();
+    for (INT32 y : part.events)
+    {
+        part.active.clear();
+        for (UINT32 e = 0; e != edgeCount && edges[e].topyi <= y; ++e)
+        {
+            if (endOf(e) <= y) { continue; }
+            part.active.push_back(e);
+            for (size_t i = part.active.size() - 1;
+                 i != 0 && isRightOf(part.active[i - 1], part.active[i], y);
+                 --i)
+            {
+                std::swap(part.active[i - 1], part.active[i]);
+            }
+        }
+        if (part.active.size() % 2 != 0)
+        {
+            DebugPrint(L"[ERR] Find odd number of edges of plane "
+                       "#%d at y=%d.", pn.id, y);
+        }
+
+        part.kept.clear();
+        for (size_t i = 0; i + 1 < part.active.size(); i += 2)
+        {
+            const UINT32 l = part.active[i];
+            const UINT32 r = part.active[i + 1];
+            auto pair = std::find_if(part.open.begin(), part.open.end(),
+                                     [&](const OpenEdgePair & p)
+            {
+                return p.l != NO_EDGE && continues(p.l, l, y) &&
+                       continues(p.r, r, y);
+            });
+            if (pair == part.open.end())
+            {
+                const UINT32 lnode = addNode(l, y);
+                const UINT32 rnode = addNode(r, y);
+                addPlane(y, lnode, rnode, 0);
+                part.kept.push_back(OpenEdgePair{
+                    static_cast<UINT32>(part.planes.size() - 1), y, l, r,
+                    lnode, rnode, y, y});
+                continue;
+            }
+            if (pair->l != l)
+            {
+                linkNode(pair->lnode, l, y);
+                pair->l = l;
+                pair->lytop = y;
+            }
+            if (pair->r != r)
+            {
+                linkNode(pair->rnode, r, y);
+                pair->r = r;
+                pair->rytop = y;
+            }
+            part.kept.push_back(*pair);
+            pair->l = NO_EDGE;
+        }
+
+        // The pairs that do not go on end above y.
+        for (const OpenEdgePair &pair : part.open)
+        {
+            if (pair.l == NO_EDGE) { continue; }
+            part.planes[pair.plane].diffy = y - pair.ytop;
+            part.chains[pair.lnode].diffy = y - pair.lytop;
+            part.chains[pair.rnode].diffy = y - pair.rytop;
+        }
+        part.open.swap(part.kept);
+    }
+}
+
+void ObjModel::ReserveFrameScratch(const RECT & area)
+{
+    const TableBounds &bounds = m_tableBounds;
+    const size_t faceCount = m_faces.GetCount();
+    const size_t rowCount = area.bottom - area.top;
+    m_planes.offsets.reserve(rowCount + 1);
+    m_planes.planes.reserve(bounds.planes);
+    m_edgeChains.reserve(bounds.chains);
+    m_usedEdges.reserve(m_meshEdges.size());
+    m_edgeUsed.reserve(m_meshEdges.size());
+    m_frontFacing.reserve(faceCount);
+    m_activeEdgePairs.reserve(bounds.planes);
+    m_rowSpans.reserve(bounds.planes);
+    m_coveringSpans.reserve(bounds.planes);
+    m_shownFaces.reserve(faceCount);
+    m_planeColumns.reserve(faceCount);
+
+    // InitTables() gives a part at most partFaces faces: it uses fewer
+    // threads only when each gets fewer than 2 * PARALLEL_TABLE_MIN_FACES.
+    // The chains of a single part are swapped with m_edgeChains.
+    const UINT32 partCount = m_tableThreadCount != 0 ?
+                             m_tableThreadCount : Parallel::GetThreadCount();
+    size_t partFaces = (faceCount + partCount - 1) / partCount;
+    if (m_tableThreadCount == 0 && partFaces < 2 * PARALLEL_TABLE_MIN_FACES)
+    {
+        partFaces = 2 * PARALLEL_TABLE_MIN_FACES;
+    }
+    if (partFaces > faceCount) partFaces = faceCount;
+    size_t partPlanes = partFaces * bounds.facePlanes;
+    if (partPlanes > bounds.planes) partPlanes = bounds.planes;
+    size_t partChains = partFaces * bounds.faceChains;
+    if (partChains > bounds.chains) partChains = bounds.chains;
+
+    if (m_tableParts.size() < partCount) { m_tableParts.resize(partCount); }
+    for (size_t t = 0; t != m_tableParts.size(); ++t)
+    {
+        TablePart &part = m_tableParts[t];
+        part.planes.reserve(partPlanes);
+        part.rows.reserve(partPlanes);
+        part.rowCounts.reserve(rowCount);
+        part.chains.reserve(t == 0 ? bounds.chains : partChains);
+        part.edges.reserve(bounds.faceSize);
+        part.events.reserve(2 * bounds.faceSize);
+        part.active.reserve(bounds.faceSize);
+        part.open.reserve(bounds.faceSize / 2);
+        part.kept.reserve(bounds.faceSize / 2);
+    }
+}
+
+void ObjModel::InitTables(const RECT & area)
+{
+    m_tableRect = m_boundingRect;
+    if (m_tableRect.left < area.left) m_tableRect.left = area.left;
+    if (m_tableRect.right >= area.right) m_tableRect.right = area.right - 1;
+    if (m_tableRect.top < area.top) m_tableRect.top = area.top;
+    if (m_tableRect.bottom >= area.bottom) m_tableRect.bottom = area.bottom - 1;
+    const bool clipColumns = m_tableRect.left != m_boundingRect.left ||
+                             m_tableRect.right != m_boundingRect.right;
+
+    m_planeColumns.clear();
+    m_planes.offsets.resize(1);
+    m_planes.planes.clear();
+    m_culledFaceCount = 0;
+    if (m_tableRect.left > m_tableRect.right ||
+        m_tableRect.top > m_tableRect.bottom)
+    {
+        // No rows for Rasterize() to walk.
+        m_tableRect.bottom = m_tableRect.top - 1;
+        return;
+    }
+    const size_t rowCount = m_tableRect.bottom - m_tableRect.top + 1;
+
+    if (m_faceEdges.size() != m_faces.vertices.size()) { InitEdgeAdjacency(); }
+
+    // When faces are dropped, only the edges of the remaining faces are
+    // set up.
+    const bool allEdges = m_allFacesVisible && !m_backFaceCulling;
+    m_usedEdges.clear();
+    if (!allEdges)
+    {
+        // The sign of c, the z component of the normal, tells the way a face
+        // is turned. The screen y axis points down and z points away from
+        // the viewer, so c > 0 for a counterclockwise back face.
+        const REAL backSign =
+            m_frontFace == FrontFace::COUNTERCLOCKWISE ? 1.0f : -1.0f;
+        if (m_backFaceCulling) { m_frontFacing.resize(m_faces.GetCount()); }
+        m_edgeUsed.resize(m_meshEdges.size(), 0);
+        for (UINT32 pid : m_facesInView)
+        {
+            const UINT32 begin = m_faces.offsets[pid];
+            const UINT32 end = m_faces.offsets[pid + 1];
+            if (m_backFaceCulling)
+            {
+                const auto &p1 =
+                    m_transformedVertices[m_faces.vertices[begin]];
+                const auto &p2 =
+                    m_transformedVertices[m_faces.vertices[begin + 1]];
+                const auto &p3 =
+                    m_transformedVertices[m_faces.vertices[begin + 2]];
+                REAL c = (p2.x - p1.x) * (p3.y - p1.y) -
+                         (p3.x - p1.x) * (p2.y - p1.y);
+                m_frontFacing[pid] = c * backSign > 0 ? 0 : 1;
+                if (!m_frontFacing[pid])
+                {
+                    ++m_culledFaceCount;
+                    continue;
+                }
+            }
+            for (UINT32 k = begin; k != end; ++k)
+            {
+                const UINT32 eid = m_faceEdges[k];
+                if (m_edgeUsed[eid]) { continue; }
+                m_edgeUsed[eid] = 1;
+                m_usedEdges.push_back(eid);
+            }
+        }
+        for (UINT32 eid : m_usedEdges)
+            m_edgeUsed[eid] = 0;
+    }
+
+    // Set up every edge once, for all faces it belongs to, and the planes
+    // of the faces in table parts of consecutive faces. The parts are put
+    // together in face order, so the tables are the same for any number of
+    // threads.
+    m_edges.resize(m_meshEdges.size());
+    const size_t edgeCount = allEdges ? m_meshEdges.size() :
+                                        m_usedEdges.size();
+    const size_t faceCount = m_facesInView.size();
+    UINT32 threadCount = m_tableThreadCount != 0 ? m_tableThreadCount :
+                                                   Parallel::GetThreadCount();
+    if (m_tableThreadCount == 0 &&
+        threadCount > faceCount / PARALLEL_TABLE_MIN_FACES)
+    {
+        threadCount = static_cast<UINT32>(faceCount /
+                                          PARALLEL_TABLE_MIN_FACES);
+    }
+    if (threadCount == 0) threadCount = 1;
+    ReserveFrameScratch(area);
+
+    REAL lightN = 1 / std::sqrt(m_light.x * m_light.x + m_light.y * m_light.y +
+                                m_light.z * m_light.z);
+
+    Parallel::For(threadCount, [&](UINT32 t)
+    {
+        for (size_t i = edgeCount * t / threadCount;
+             i != edgeCount * (t + 1) / threadCount; ++i)
+        {
+            InitEdge(allEdges ? i : m_usedEdges[i]);
+        }
+    });
+
+    Parallel::For(threadCount, [&](UINT32 t)
+    {
+        TablePart &part = m_tableParts[t];
+        part.planes.clear();
+        part.rows.clear();
+        part.rowCounts.assign(rowCount, 0);
+        part.chains.clear();
+        for (size_t i = faceCount * t / threadCount;
+             i != faceCount * (t + 1) / threadCount; ++i)
+        {
+            const UINT32 pid = m_facesInView[i];
+            if (m_backFaceCulling && !m_frontFacing[pid]) { continue; }
+            InitPlane(pid, clipColumns, lightN, part);
+        }
+    });
+
+    // Turn the counts into the position of the first plane of each part
+    // in each row, and give each part its place in m_edgeChains. The
+    // chains of a single part are taken as they are.
+    UINT32 chainCount = 0;
+    for (UINT32 t = 0; t != threadCount; ++t)
+    {
+        TablePart &part = m_tableParts[t];
+        part.chainBase = chainCount;
+        chainCount += static_cast<UINT32>(part.chains.size());
+    }
+    if (threadCount == 1) { m_edgeChains.swap(m_tableParts[0].chains); }
+    else { m_edgeChains.resize(chainCount); }
+    m_planes.offsets.resize(rowCount + 1);
+    UINT32 count = 0;
+    for (size_t row = 0; row != rowCount; ++row)
+    {
+        for (UINT32 t = 0; t != threadCount; ++t)
+        {
+            TablePart &part = m_tableParts[t];
+            const UINT32 partCount = part.rowCounts[row];
+            part.rowCounts[row] = count;
+            count += partCount;
+        }
+        m_planes.offsets[row + 1] = count;
+    }
+    m_planes.planes.resize(count);
+
+    Parallel::For(threadCount, [&](UINT32 t)
+    {
+        TablePart &part = m_tableParts[t];
+        for (size_t i = 0; i != part.planes.size(); ++i)
+        {
+            PlaneNode &pl = m_planes.planes[part.rowCounts[part.rows[i]]++];
+            pl = part.planes[i];
+            pl.left += part.chainBase;
+            pl.right += part.chainBase;
+        }
+        for (size_t i = 0; threadCount != 1 && i != part.chains.size(); ++i)
+        {
+            EdgeChainNode &node = m_edgeChains[part.chainBase + i];
+            node = part.chains[i];
+            if (node.next != NO_EDGE) { node.next += part.chainBase; }
+        }
+    });
+}
+
+void ObjModel::SetBackFaceCulling(bool enabled, FrontFace frontFace)
+{
+    if (enabled == m_backFaceCulling && frontFace == m_frontFace) { return; }
+    m_backFaceCulling = enabled;
+    m_frontFace = frontFace;
+    m_frame.valid = false;
+}
+
+void ObjModel::SetRasterEngine(RasterEngine engine)
+{
+    if (engine == m_rasterEngine) { return; }
+    m_rasterEngine = engine;
+    m_frame.valid = false;
+}
+
+void ObjModel::GetBuffer(OffscreenBuffer &buffer, REAL scaleFactor,
+                         REAL degreeX, REAL degreeY, REAL shiftX, REAL shiftY)
+{
+    INT32 width = buffer.GetWidth();
+    INT32 height = buffer.GetHeight();
+
+    // Moving the model by whole pixels moves its image by as many pixels,
+    // so a frame that differs from the last one only by such a shift is
+    // drawn by moving the last frame and drawing the uncovered strips from
+    // the tables of the last frame.
+    m_rasterStats = RasterStats{0, 0, 0, 0};
+    REAL panX = shiftX - m_frame.shiftX;
+    REAL panY = shiftY - m_frame.shiftY;
+    bool pan = m_frame.valid && m_frame.width == width &&
+        m_frame.height == height && m_frame.scaleFactor == scaleFactor &&
+        m_frame.degreeX == degreeX && m_frame.degreeY == degreeY &&
+        panX == std::floor(panX) && panY == std::floor(panY) &&
+        std::fabs(panX) < MAX_PAN && std::fabs(panY) < MAX_PAN;
+    if (pan)
+    {
+        // The tables must cover the part of the model in the moved frame.
+        RECT visible{-static_cast<INT32>(panX), -static_cast<INT32>(panY),
+                     width - 1 - static_cast<INT32>(panX),
+                     height - 1 - static_cast<INT32>(panY)};
+        if (visible.left < m_boundingRect.left)
+            visible.left = m_boundingRect.left;
+        if (visible.right > m_boundingRect.right)
+            visible.right = m_boundingRect.right;
+        if (visible.top < m_boundingRect.top)
+            visible.top = m_boundingRect.top;
+        if (visible.bottom > m_boundingRect.bottom)
+            visible.bottom = m_boundingRect.bottom;
+        pan = visible.left > visible.right || visible.top > visible.bottom ||
+              visible.left >= m_tableRect.left &&
+              visible.right <= m_tableRect.right &&
+              visible.top >= m_tableRect.top &&
+              visible.bottom <= m_tableRect.bottom;
+    }
+    if (pan)
+    {
+        PanFrame(static_cast<INT32>(panX) - m_frame.offsetX,
+                 static_cast<INT32>(panY) - m_frame.offsetY);
+    }
+    else
+    {
+        const INT32 marginX = width / PAN_MARGIN_DIVISOR;
+        const INT32 marginY = height / PAN_MARGIN_DIVISOR;
+        const RECT area{-marginX, -marginY, width + marginX, height + marginY};
+        TransformModel(width, height, scaleFactor,
+                       degreeX, degreeY, shiftX, shiftY, area);
+        InitTables(area);
+
+        m_frame.valid = true;
+        m_frame.width = width;
+        m_frame.height = height;
+        m_frame.scaleFactor = scaleFactor;
+        m_frame.degreeX = degreeX;
+        m_frame.degreeY = degreeY;
+        m_frame.shiftX = shiftX;
+        m_frame.shiftY = shiftY;
+        m_frame.offsetX = 0;
+        m_frame.offsetY = 0;
+        // Rasterize() fills every pixel, so the rows are only replaced when
+        // the size changes.
+        if (m_frame.rows.size() != static_cast<size_t>(height) ||
+            height != 0 && m_frame.rows[0].size() != static_cast<size_t>(width))
+        {
+            m_frame.rows.assign(height, std::vector<Color>(width));
+        }
+        if (m_rasterEngine == RasterEngine::SPANS)
+            RasterizeBySpans(RECT{0, 0, width, height});
+        else
+            Rasterize(RECT{0, 0, width, height});
+    }
+
+    for (INT32 y = 0; y < height; ++y)
+        buffer.SetRow(y, m_frame.rows[y]);
+
+    // For debug purpose, draw all transformed vertices.
+    auto drawVertex = [&](const Position3R & v)
+    {
+        buffer.DebugDrawPoint(std::lround(v.x) + m_frame.offsetX,
+                              std::lround(v.y) + m_frame.offsetY,
+                              Color::GREEN);
+    };
+    if (m_allFacesVisible)
+    {
+        for (const auto & v : m_transformedVertices)
+            drawVertex(v);
+    }
+    for (const Range &run : m_vertexRuns)
+    {
+        for (UINT32 k = run.begin; k != run.end; ++k)
+            drawVertex(m_runVertices[k]);
+    }
+    // For debug purpose, draw bounding rectangle.
+    RECT rect = m_boundingRect;
+    OffsetRect(&rect, m_frame.offsetX, m_frame.offsetY);
+    buffer.DebugDrawRectangle(rect, Color::BLUE);
+}
+
+void ObjModel::PanFrame(INT32 dx, INT32 dy)
+{
+    m_frame.offsetX += dx;
+    m_frame.offsetY += dy;
+    const INT32 width = m_frame.width;
+    const INT32 height = m_frame.height;
+    if (dx <= -width || dx >= width || dy <= -height || dy >= height)
+    {
+        if (m_rasterEngine == RasterEngine::SPANS)
+            RasterizeBySpans(RECT{0, 0, width, height});
+        else
+            Rasterize(RECT{0, 0, width, height});
+        return;
+    }
+
+    auto &rows = m_frame.rows;
+    if (dy > 0) { std::rotate(rows.begin(), rows.end() - dy, rows.end()); }
+    if (dy < 0) { std::rotate(rows.begin(), rows.begin() - dy, rows.end()); }
+    if (dx > 0)
+    {
+        for (auto &row : rows)
+            std::copy_backward(row.begin(), row.end() - dx, row.end());
+    }
+    if (dx < 0)
+    {
+        for (auto &row : rows)
+            std::copy(row.begin() - dx, row.end(), row.begin());
+    }
+
+    // The rows that moved in, then the columns that moved in on the other
+    // rows.
+    INT32 top = 0;
+    INT32 bottom = height;
+    if (dy > 0)
+    {
+        RasterizeByPlane(RECT{0, 0, width, dy});
+        top = dy;
+    }
+    if (dy < 0)
+    {
+        RasterizeByPlane(RECT{0, height + dy, width, height});
+        bottom = height + dy;
+    }
+    if (dx > 0) { RasterizeByPlane(RECT{0, top, dx, bottom}); }
+    if (dx < 0) { RasterizeByPlane(RECT{width + dx, top, width, bottom}); }
+}
+
+void ObjModel::StartEdgePair(const PlaneNode & pl, INT32 y,
+                             ActiveEdgePairNode & epn) const
+{
+    epn.l = m_edgeChains[pl.left];
+    epn.r = m_edgeChains[pl.right];
+    // NOTE(jaege): zl may lose some precision since y is rounded.
+    // TODO(jaege): Test if this is ok.
+    epn.zl = -(pl.plane.a * epn.l.x + pl.plane.b * y +
+               pl.plane.d) / pl.plane.c;
+    epn.dzx = -pl.plane.a / pl.plane.c;
+    epn.dzy = -pl.plane.b / pl.plane.c;
+    epn.plane = m_planes.GetIndex(pl);
+    epn.rank = GetFaceRank(pl.id);
+    epn.color = pl.color;
+}
+
+bool ObjModel::StepEdgePair(ActiveEdgePairNode & epn, INT32 y) const
+{
+    --epn.l.diffy;
+    --epn.r.diffy;
+
+    // Replace finished edges by the next nodes of their sides.
+    const INT32 nextRow = y - m_tableRect.top + 1;
+    if (nextRow >= 0 &&
+        static_cast<size_t>(nextRow) < m_planes.GetRowCount())
+    {
+        if (epn.l.diffy == 0)
+        {
+            if (epn.l.next == NO_EDGE) { return false; }
+            epn.l = m_edgeChains[epn.l.next];
+        }
+        else
+        {
+            epn.l.x += epn.l.dx;
+        }
+        if (epn.r.diffy == 0)
+        {
+            if (epn.r.next == NO_EDGE) { return false; }
+            epn.r = m_edgeChains[epn.r.next];
+        }
+        else
+        {
+            epn.r.x += epn.r.dx;
+        }
+    }
+    epn.zl += epn.dzx * epn.l.dx + epn.dzy;
+    return true;
+}
+
+void ObjModel::DrawSpan(const ActiveEdgePairNode & epn, const Color * color,
+                        const RECT & rect, Color * frameRow,
+                        const DepthRow & row, RasterStats & stats) const
+{
+    INT32 xl = static_cast<INT32>(std::ceil(epn.l.x));
+    INT32 xr = static_cast<INT32>(std::ceil(epn.r.x - 1.0f));
+    if (xl >= rect.right || xr < rect.left) { return; }
+    frameRow -= rect.left;
+    REAL *depthRow = row.depth - rect.left;
+    UINT32 *rankRow = row.ranks - rect.left;
+
+    // Clamp the span to rect. The depth of a pixel is computed from the
+    // left end of the span and not stepped from the previous pixel, so
+    // that it is the same whatever part of the frame is drawn, and the
+    // part of a long span left of rect costs nothing.
+    INT32 xbegin = xl > rect.left ? xl : rect.left;
+    INT32 xend = xr < rect.right ? xr : rect.right - 1;
+    UINT64 written = 0;
+    if (!row.blocks)
+    {
+        REAL dx = static_cast<REAL>(xbegin - xl);
+        for (INT32 x = xbegin; x <= xend; ++x, dx += 1)
+        {
+            REAL z = epn.zl + epn.dzx * dx;
+            if (z < depthRow[x] ||
+                z == depthRow[x] && epn.rank < rankRow[x])
+            {
+                // Update depthBuffer and frameBuffer.
+                depthRow[x] = z;
+                rankRow[x] = epn.rank;
+                if (color) { frameRow[x] = *color; }
+                ++written;
+            }
+        }
+        stats.pixelsTested += xend - xbegin + 1;
+        stats.pixelsWritten += written;
+        return;
+    }
+
+    // The depths of the span in a block or tile are taken from its ends,
+    // widened by the rounding error of the depth of a pixel.
+    const REAL slack = (std::fabs(epn.zl) +
+                        std::fabs(epn.dzx) * (xend - xl + 1)) *
+                       4 * std::numeric_limits<REAL>::epsilon();
+    auto depthAt = [&](INT32 x)
+    {
+        return epn.zl + epn.dzx * static_cast<REAL>(x - xl);
+    };
+    constexpr INT32 blocksPerTile = COARSE_DEPTH_TILE / COARSE_DEPTH_BLOCK;
+    const INT32 blockCount = (rect.right - rect.left +
+                              COARSE_DEPTH_BLOCK - 1) / COARSE_DEPTH_BLOCK;
+    INT32 tile = (xbegin - rect.left) / COARSE_DEPTH_TILE;
+    for (INT32 tfirst = xbegin; tfirst <= xend; ++tile)
+    {
+        INT32 tileRight = rect.left + (tile + 1) * COARSE_DEPTH_TILE - 1;
+        INT32 tlast = xend < tileRight ? xend : tileRight;
+        // The part of a span in one block is only tested against the block.
+        if (tlast - tfirst >= COARSE_DEPTH_BLOCK)
+        {
+            REAL z1 = depthAt(tfirst);
+            REAL z2 = depthAt(tlast);
+            if ((z1 < z2 ? z1 : z2) - slack > row.tiles[tile])
+            {
+                stats.pixelsSkipped += tlast - tfirst + 1;
+                tfirst = tlast + 1;
+                continue;
+            }
+        }
+
+        bool changed = false;
+        INT32 block = (tfirst - rect.left) / COARSE_DEPTH_BLOCK;
+        for (INT32 xfirst = tfirst; xfirst <= tlast; ++block)
+        {
+            INT32 blockLeft = rect.left + block * COARSE_DEPTH_BLOCK;
+            INT32 blockRight = blockLeft + COARSE_DEPTH_BLOCK - 1;
+            if (blockRight >= rect.right) blockRight = rect.right - 1;
+            INT32 xlast = xend < blockRight ? xend : blockRight;
+            const INT32 count = xlast - xfirst + 1;
+            const INT32 x = xfirst;
+            xfirst = xlast + 1;
+
+            REAL z1 = depthAt(x);
+            REAL z2 = depthAt(xlast);
+            REAL zmin = (z1 < z2 ? z1 : z2) - slack;
+            REAL zmax = (z1 < z2 ? z2 : z1) + slack;
+            // A span as deep as the block may still win a pixel from a
+            // span of a higher rank.
+            if (zmin > row.blocks[block])
+            {
+                stats.pixelsSkipped += count;
+                continue;
+            }
+            UINT64 blockWritten = 0;
+            REAL dx = static_cast<REAL>(x - xl);
+            if (zmax < row.blockMins[block])
+            {
+                // In front of every pixel of the block.
+                for (INT32 px = x; px <= xlast; ++px, dx += 1)
+                {
+                    depthRow[px] = epn.zl + epn.dzx * dx;
+                    rankRow[px] = epn.rank;
+                    if (color) { frameRow[px] = *color; }
+                }
+                blockWritten = count;
+                stats.pixelsFilled += count;
+            }
+            else
+            {
+                for (INT32 px = x; px <= xlast; ++px, dx += 1)
+                {
+                    REAL z = epn.zl + epn.dzx * dx;
+                    if (z < depthRow[px] ||
+                        z == depthRow[px] && epn.rank < rankRow[px])
+                    {
+                        depthRow[px] = z;
+                        rankRow[px] = epn.rank;
+                        if (color) { frameRow[px] = *color; }
+                        ++blockWritten;
+                    }
+                }
+                stats.pixelsTested += count;
+            }
+            if (blockWritten == 0) { continue; }
+            written += blockWritten;
+
+            // The pixels only ever get nearer, so the written ones bound
+            // the block from below, and its largest depth is taken anew.
+            if (zmin < row.blockMins[block]) row.blockMins[block] = zmin;
+            REAL blockMax = depthRow[blockLeft];
+            for (INT32 px = blockLeft + 1; px <= blockRight; ++px)
+            {
+                if (blockMax < depthRow[px]) blockMax = depthRow[px];
+            }
+            row.blocks[block] = blockMax;
+            changed = true;
+        }
+
+        if (changed)
+        {
+            INT32 first = tile * blocksPerTile;
+            INT32 last = first + blocksPerTile < blockCount ?
+                         first + blocksPerTile : blockCount;
+            REAL tileMax = row.blocks[first];
+            for (INT32 b = first + 1; b < last; ++b)
+            {
+                if (tileMax < row.blocks[b]) tileMax = row.blocks[b];
+            }
+            row.tiles[tile] = tileMax;
+        }
+        tfirst = tlast + 1;
+    }
+    stats.pixelsWritten += written;
+}
+
+void ObjModel::Rasterize(const RECT & frameRect)
+{
+    if (frameRect.left >= frameRect.right ||
+        frameRect.top >= frameRect.bottom)
+    {
+        return;
+    }
+
+    for (INT32 y = frameRect.top; y < frameRect.bottom; ++y)
+    {
+        std::fill(m_frame.rows[y].begin() + frameRect.left,
+                  m_frame.rows[y].begin() + frameRect.right,
+                  m_backgroundColor);
+    }
+
+    // The same rectangle in the coordinates of the tables.
+    RECT rect = frameRect;
+    OffsetRect(&rect, -m_frame.offsetX, -m_frame.offsetY);
+
+    // The depth state of the whole rectangle is kept, so that the faces
+    // left for later are drawn against it.
+    const INT32 rectWidth = rect.right - rect.left;
+    const INT32 blockCount = (rectWidth + COARSE_DEPTH_BLOCK - 1) /
+                             COARSE_DEPTH_BLOCK;
+    const size_t rowCount = rect.bottom - rect.top;
+    m_depthBuffer.assign(rowCount * rectWidth, REAL_MAX);
+    const INT32 tileCount = GetTileCount(blockCount);
+    m_blockDepth.assign(rowCount * blockCount, REAL_MAX);
+    m_blockMinDepth.assign(rowCount * blockCount, REAL_MAX);
+    m_tileDepth.assign(rowCount * tileCount, REAL_MAX);
+    m_rankBuffer.assign(rowCount * rectWidth, NO_RANK);
+    const DepthRow rows{m_depthBuffer.data(), m_blockDepth.data(),
+                        m_blockMinDepth.data(), m_tileDepth.data(),
+                        m_rankBuffer.data()};
+
+    // Most faces visible in the last frame are visible in this one too.
+    // Only they are drawn scan-line by scan-line, the other faces are then
+    // drawn one by one where the coarse depth cannot rule them out.
+    const bool deferHidden = !m_shownFaces.empty() &&
+                             m_faceShown.size() == m_faces.GetCount();
+
+    std::vector<ActiveEdgePairNode> &activeEdgePairs = m_activeEdgePairs;
+    activeEdgePairs.clear();
+    INT32 ylast = m_tableRect.bottom < rect.bottom - 1 ?
+                  m_tableRect.bottom : rect.bottom - 1;
+    for (INT32 y = m_tableRect.top; y <= ylast; ++y)
+    {
+        // Add the edge pairs of the planes starting at this scan-line.
+        for (const auto &pl : m_planes.GetRow(y - m_tableRect.top))
+        {
+            if (deferHidden && !m_faceShown[pl.id]) { continue; }
+
+            // Add edge pair of newly added plane to activeEdgePairs, which
+            // are kept sorted front to back, so that the coarse depth
+            // rejects as many spans as possible.
+            ActiveEdgePairNode epn;
+            StartEdgePair(pl, y, epn);
+            auto pos = std::upper_bound(
+                activeEdgePairs.begin(), activeEdgePairs.end(), pl.zmin,
+                [this](REAL zmin, const ActiveEdgePairNode & rhs)
+            {
+                return zmin < m_planes.planes[rhs.plane].zmin;
+            });
+            activeEdgePairs.insert(pos, epn);
+        }
+
+        // Rows above rect only keep the active edges up to date.
+        if (y >= rect.top)
+        {
+            Color *frameRow = m_frame.rows[y + m_frame.offsetY].data() +
+                              frameRect.left;
+            const size_t i = y - rect.top;
+            const DepthRow row{rows.depth + i * rectWidth,
+                               rows.blocks + i * blockCount,
+                               rows.blockMins + i * blockCount,
+                               rows.tiles + i * tileCount,
+                               rows.ranks + i * rectWidth};
+
+            for (const auto &epn : activeEdgePairs)
+                DrawSpan(epn, &epn.color, rect, frameRow, row, m_rasterStats);
+        }
+
+        // Update activeEdgePairs, keeping the ones that go on in order.
+        size_t kept = 0;
+        for (size_t i = 0; i != activeEdgePairs.size(); ++i)
+        {
+            if (!StepEdgePair(activeEdgePairs[i], y)) { continue; }
+            if (kept != i) { activeEdgePairs[kept] = activeEdgePairs[i]; }
+            ++kept;
+        }
+        activeEdgePairs.resize(kept);
+    }
+
+    if (deferHidden)
+    {
+        if (m_planeColumns.empty()) { InitPlaneColumns(); }
+        for (INT32 ytop = m_tableRect.top; ytop <= ylast; ++ytop)
+        {
+            for (const auto &pl : m_planes.GetRow(ytop - m_tableRect.top))
+            {
+                const PlaneColumns &columns = m_planeColumns[pl.id];
+                if (m_faceShown[pl.id] ||
+                    columns.left >= rect.right || columns.right < rect.left ||
+                    ytop + static_cast<INT32>(pl.diffy) <= rect.top)
+                {
+                    continue;
+                }
+                DrawPlane(pl, ytop, frameRect, rows, blockCount);
+            }
+        }
+    }
+
+    // Remember the faces that won a pixel for the next frame.
+    if (!m_faceIds.empty() && m_rankFaces.empty())
+    {
+        UINT32 rankCount = 0;
+        for (UINT32 rank : m_faceIds)
+        {
+            if (rankCount <= rank) rankCount = rank + 1;
+        }
+        m_rankFaces.resize(rankCount);
+        for (UINT32 pid = 0; pid != m_faceIds.size(); ++pid)
+            m_rankFaces[m_faceIds[pid]] = pid;
+    }
+    m_faceShown.assign(m_faces.GetCount(), 0);
+    for (UINT32 rank : m_rankBuffer)
+    {
+        if (rank == NO_RANK) { continue; }
+        m_faceShown[m_faceIds.empty() ? rank : m_rankFaces[rank]] = 1;
+    }
+    m_shownFaces.clear();
+    for (UINT32 pid = 0; pid != m_faceShown.size(); ++pid)
+    {
+        if (m_faceShown[pid]) { m_shownFaces.push_back(pid); }
+    }
+}
+
+void ObjModel::RasterizeBySpans(const RECT & frameRect)
+{
+    if (frameRect.left >= frameRect.right ||
+        frameRect.top >= frameRect.bottom)
+    {
+        return;
+    }
+
+    for (INT32 y = frameRect.top; y < frameRect.bottom; ++y)
+    {
+        std::fill(m_frame.rows[y].begin() + frameRect.left,
+                  m_frame.rows[y].begin() + frameRect.right,
+                  m_backgroundColor);
+    }
+
+    RECT rect = frameRect;
+    OffsetRect(&rect, -m_frame.offsetX, -m_frame.offsetY);
+    m_faceShown.assign(m_faces.GetCount(), 0);
+
+    // The active edge pairs are kept sorted by the left end of their spans,
+    // so that the spans of a scan-line come out from left to right.
+    std::vector<ActiveEdgePairNode> &activeEdgePairs = m_activeEdgePairs;
+    activeEdgePairs.clear();
+    auto leftOf = [](const ActiveEdgePairNode & lhs,
+                     const ActiveEdgePairNode & rhs)
+    {
+        return lhs.l.x < rhs.l.x;
+    };
+    INT32 ylast = m_tableRect.bottom < rect.bottom - 1 ?
+                  m_tableRect.bottom : rect.bottom - 1;
+    for (INT32 y = m_tableRect.top; y <= ylast; ++y)
+    {
+        for (const auto &pl : m_planes.GetRow(y - m_tableRect.top))
+        {
+            ActiveEdgePairNode epn;
+            StartEdgePair(pl, y, epn);
+            activeEdgePairs.insert(
+                std::upper_bound(activeEdgePairs.begin(),
+                                 activeEdgePairs.end(), epn, leftOf),
+                epn);
+        }
+
+        if (y >= rect.top)
+        {
+            auto &spans = m_rowSpans;
+            spans.clear();
+            for (const auto &epn : activeEdgePairs)
+            {
+                INT32 xl = static_cast<INT32>(std::ceil(epn.l.x));
+                INT32 xr = static_cast<INT32>(std::ceil(epn.r.x - 1.0f));
+                if (xl > xr || xl >= rect.right || xr < rect.left) continue;
+                RowSpan span;
+                span.xl = xl;
+                span.xbegin = xl > rect.left ? xl : rect.left;
+                span.xend = xr < rect.right ? xr : rect.right - 1;
+                span.zl = epn.zl;
+                span.dzx = epn.dzx;
+                span.slack = (std::fabs(epn.zl) +
+                              std::fabs(epn.dzx) * (span.xend - xl + 1)) *
+                             4 * std::numeric_limits<REAL>::epsilon();
+                span.rank = epn.rank;
+                span.face = m_planes.planes[epn.plane].id;
+                span.color = epn.color;
+                spans.push_back(span);
+            }
+
+            // Sweep the spans from left to right, drawing every interval
+            // between two span ends with the spans covering it.
+            Color *frameRow = m_frame.rows[y + m_frame.offsetY].data() +
+                              frameRect.left - rect.left;
+            auto &covering = m_coveringSpans;
+            covering.clear();
+            size_t next = 0;
+            INT32 x = rect.left;
+            while (next != spans.size() || !covering.empty())
+            {
+                if (covering.empty()) { x = spans[next].xbegin; }
+                while (next != spans.size() && spans[next].xbegin == x)
+                {
+                    covering.push_back(static_cast<UINT32>(next++));
+                }
+                INT32 xend = next != spans.size() ? spans[next].xbegin :
+                                                    rect.right;
+                for (UINT32 s : covering)
+                {
+                    if (xend > spans[s].xend + 1) xend = spans[s].xend + 1;
+                }
+                DrawInterval(x, xend, covering.data(), covering.size(),
+                             frameRow, m_rasterStats);
+                covering.erase(
+                    std::remove_if(covering.begin(), covering.end(),
+                                   [&](UINT32 s)
+                {
+                    return spans[s].xend < xend;
+                }), covering.end());
+                x = xend;
+            }
+        }
+
+        // Update activeEdgePairs, then restore their order, which stepping
+        // changes only where edges cross.
+        size_t kept = 0;
+        for (size_t i = 0; i != activeEdgePairs.size(); ++i)
+        {
+            if (!StepEdgePair(activeEdgePairs[i], y)) { continue; }
+            if (kept != i) { activeEdgePairs[kept] = activeEdgePairs[i]; }
+            ++kept;
+        }
+        activeEdgePairs.resize(kept);
+        for (size_t i = 1; i < kept; ++i)
+        {
+            if (!leftOf(activeEdgePairs[i], activeEdgePairs[i - 1])) continue;
+            ActiveEdgePairNode epn = activeEdgePairs[i];
+            size_t j = i;
+            for (; j != 0 && leftOf(epn, activeEdgePairs[j - 1]); --j)
+                activeEdgePairs[j] = activeEdgePairs[j - 1];
+            activeEdgePairs[j] = epn;
+        }
+    }
+
+    m_shownFaces.clear();
+    for (UINT32 pid = 0; pid != m_faceShown.size(); ++pid)
+    {
+        if (m_faceShown[pid]) { m_shownFaces.push_back(pid); }
+    }
+}
+
+void ObjModel::DrawInterval(INT32 x1, INT32 x2, const UINT32 * covering,
+                            size_t count, Color * frameRow,
+                            RasterStats & stats)
+{
+    const RowSpan *spans = m_rowSpans.data();
+    auto depthAt = [](const RowSpan & span, INT32 x)
+    {
+        return span.zl + span.dzx * static_cast<REAL>(x - span.xl);
+    };
+    auto fill = [&](const RowSpan & span)
+    {
+        std::fill(frameRow + x1, frameRow + x2, span.color);
+        m_faceShown[span.face] = 1;
+        stats.pixelsWritten += x2 - x1;
+        stats.pixelsFilled += x2 - x1;
+    };
+    if (count == 1)
+    {
+        fill(spans[covering[0]]);
+        return;
+    }
+
+    // The span in front at x1, which is in front of the whole interval if
+    // every other span is behind it at both ends by more than the rounding
+    // error of both, as the depths of the pixels are linear in x but for
+    // that error.
+    const RowSpan *front = &spans[covering[0]];
+    REAL zfront = depthAt(*front, x1);
+    for (size_t i = 1; i != count; ++i)
+    {
+        const RowSpan &span = spans[covering[i]];
+        REAL z = depthAt(span, x1);
+        if (z < zfront || z == zfront && span.rank < front->rank)
+        {
+            front = &span;
+            zfront = z;
+        }
+    }
+    const REAL zfrontLast = depthAt(*front, x2 - 1);
+    bool clear = true;
+    for (size_t i = 0; i != count && clear; ++i)
+    {
+        const RowSpan &span = spans[covering[i]];
+        if (&span == front) { continue; }
+        const REAL margin = 2 * (span.slack + front->slack);
+        clear = depthAt(span, x1) - zfront > margin &&
+                depthAt(span, x2 - 1) - zfrontLast > margin;
+    }
+    if (clear)
+    {
+        fill(*front);
+        return;
+    }
+
+    // Spans cross or touch in the interval, look closer.
+    if (x2 - x1 > MIN_SPAN_INTERVAL)
+    {
+        const INT32 xmid = x1 + (x2 - x1) / 2;
+        DrawInterval(x1, xmid, covering, count, frameRow, stats);
+        DrawInterval(xmid, x2, covering, count, frameRow, stats);
+        return;
+    }
+    for (INT32 x = x1; x != x2; ++x)
+    {
+        front = &spans[covering[0]];
+        zfront = depthAt(*front, x);
+        for (size_t i = 1; i != count; ++i)
+        {
+            const RowSpan &span = spans[covering[i]];
+            REAL z = depthAt(span, x);
+            if (z < zfront || z == zfront && span.rank < front->rank)
+            {
+                front = &span;
+                zfront = z;
+            }
+        }
+        frameRow[x] = front->color;
+        m_faceShown[front->face] = 1;
+    }
+    stats.pixelsTested += (x2 - x1) * count;
+    stats.pixelsWritten += x2 - x1;
+}
+
+void ObjModel::RasterizeByPlane(const RECT & frameRect)
+{
+    if (frameRect.left >= frameRect.right ||
+        frameRect.top >= frameRect.bottom)
+    {
+        return;
+    }
+
+    for (INT32 y = frameRect.top; y < frameRect.bottom; ++y)
+    {
+        std::fill(m_frame.rows[y].begin() + frameRect.left,
+                  m_frame.rows[y].begin() + frameRect.right,
+                  m_backgroundColor);
+    }
+
+    RECT rect = frameRect;
+    OffsetRect(&rect, -m_frame.offsetX, -m_frame.offsetY);
+
+    if (m_planeColumns.empty()) { InitPlaneColumns(); }
+
+    const INT32 rectWidth = rect.right - rect.left;
+    m_depthBuffer.assign(rectWidth * (rect.bottom - rect.top), REAL_MAX);
+    m_rankBuffer.assign(rectWidth * (rect.bottom - rect.top), NO_RANK);
+    const DepthRow rows{m_depthBuffer.data(), nullptr, nullptr, nullptr,
+                        m_rankBuffer.data()};
+    INT32 ylast = m_tableRect.bottom < rect.bottom - 1 ?
+                  m_tableRect.bottom : rect.bottom - 1;
+    for (INT32 ytop = m_tableRect.top; ytop <= ylast; ++ytop)
+    {
+        for (const auto &pl : m_planes.GetRow(ytop - m_tableRect.top))
+        {
+            const PlaneColumns &columns = m_planeColumns[pl.id];
+            if (columns.left >= rect.right || columns.right < rect.left ||
+                ytop + static_cast<INT32>(pl.diffy) <= rect.top)
+            {
+                continue;
+            }
+            DrawPlane(pl, ytop, frameRect, rows, 0);
+        }
+    }
+}
+
+void ObjModel::DrawPlane(const PlaneNode & pl, INT32 ytop,
+                         const RECT & frameRect, const DepthRow & rows,
+                         INT32 blockCount)
+{
+    RECT rect = frameRect;
+    OffsetRect(&rect, -m_frame.offsetX, -m_frame.offsetY);
+    const INT32 rectWidth = rect.right - rect.left;
+    const INT32 tileCount = GetTileCount(blockCount);
+    INT32 ylast = m_tableRect.bottom < rect.bottom - 1 ?
+                  m_tableRect.bottom : rect.bottom - 1;
+
+    ActiveEdgePairNode epn;
+    StartEdgePair(pl, ytop, epn);
+    for (INT32 y = ytop; ; ++y)
+    {
+        if (y >= rect.top)
+        {
+            const size_t i = y - rect.top;
+            const DepthRow row{
+                rows.depth + i * rectWidth,
+                rows.blocks ? rows.blocks + i * blockCount : nullptr,
+                rows.blockMins ? rows.blockMins + i * blockCount : nullptr,
+                rows.tiles ? rows.tiles + i * tileCount : nullptr,
+                rows.ranks + i * rectWidth};
+            DrawSpan(epn, &epn.color, rect,
+                     m_frame.rows[y + m_frame.offsetY].data() +
+                     frameRect.left,
+                     row, m_rasterStats);
+        }
+        if (y == ylast || !StepEdgePair(epn, y)) { break; }
+    }
+}
+
+void ObjModel::InitPlaneColumns()
+{
+    // Columns crossed by the edges of each plane, widened by the rounding
+    // error the edges may gather while being stepped down the scan-lines.
+    // All the edge pairs of a face get the columns of the face.
+    m_planeColumns.resize(m_faces.GetCount());
+    for (const auto &pl : m_planes.planes)
+    {
+        REAL xmin = REAL_MAX;
+        REAL xmax = -REAL_MAX;
+        UINT32 diffy = 0;
+        const UINT32 *faceEdges = m_faceEdges.data() +
+                                  m_faces.offsets[pl.id];
+        const UINT32 faceSize = m_faces.offsets[pl.id + 1] -
+                                m_faces.offsets[pl.id];
+        for (UINT32 vid = 0; vid != faceSize; ++vid)
+        {
+            const EdgeNode &edge = m_edges[faceEdges[vid]];
+            if (edge.diffy == 0) { continue; }
+            REAL xbtm = edge.xtop + edge.dx * (edge.diffy - 1);
+            if (xmin > edge.xtop) xmin = edge.xtop;
+            if (xmin > xbtm) xmin = xbtm;
+            if (xmax < edge.xtop) xmax = edge.xtop;
+            if (xmax < xbtm) xmax = xbtm;
+            if (diffy < edge.diffy) diffy = edge.diffy;
+        }
+        REAL xabs = -xmin > xmax ? -xmin : xmax;
+        REAL margin = 2 + diffy * xabs *
+                      std::numeric_limits<REAL>::epsilon();
+        m_planeColumns[pl.id].left =
+            static_cast<INT32>(std::floor(xmin - margin));
+        m_planeColumns[pl.id].right =
+            static_cast<INT32>(std::ceil(xmax + margin));
     }
-    // For debug purpose, draw bounding rectangle.
-    buffer.DebugDrawRectangle(m_boundingRect, Color::BLUE);
 }
\ No newline at end of file
@@ -2,16 +2,161 @@
 
 #include <string>
 #include <vector>
+#include <memory>  // std::shared_ptr
+#include <functional>  // std::function
 #include <Windows.h>  // RECT
 #include "Types.h"
 #include "Color.h"
 #include "Tuple.h"  // Vector3R
 #include "OffscreenBuffer.h"
+#include "MeshCache.h"
+#include "VertexTransform.h"
 
 class ObjModel
 {
 public:
-    void LoadFromObjFile(const std::wstring & filePath);
+    // Largest scaleFactor of GetBuffer() the user interface allows.
+    static constexpr REAL MAX_SCALE_FACTOR = 50.0f;
+
+    // Largest distance in pixels a vertex may move on screen at
+    // MAX_SCALE_FACTOR in a MAX_ERROR_WIDTH * MAX_ERROR_HEIGHT buffer when
+    // the model is stored as a compressed mesh.
+    static constexpr double MAX_QUANTIZATION_ERROR = 1.0;
+    static constexpr INT32 MAX_ERROR_WIDTH = 1920;
+    static constexpr INT32 MAX_ERROR_HEIGHT = 1080;
+
+    // threadCount: number of threads used to parse the file, 0 means one per
+    //     hardware thread for large files and a single thread otherwise. The
+    //     loaded model is the same for any threadCount.
+    void LoadFromObjFile(const std::wstring & filePath, UINT32 threadCount = 0);
+
+    // Load filePath in the calling thread and hand out renderable snapshots
+    // of the part read so far to onSnapshot: the first one after
+    // facesPerSnapshot faces, the next ones each time the number of faces
+    // has grown by facesPerSnapshot and has at least doubled (so copying the
+    // snapshots costs no more than loading), and last the complete model,
+    // with final set. The bounding box of a snapshot is that of the
+    // vertices read so far. The file is parsed in slices, one per thread at
+    // a time as in LoadFromObjFile(), and loading stops before the next
+    // slices once stopRequested returns true.
+    static void LoadFromObjFileProgressive(
+        const std::wstring & filePath, size_t facesPerSnapshot,
+        const std::function<bool()> & stopRequested,
+        const std::function<void(std::shared_ptr<ObjModel>, bool final)> &
+            onSnapshot);
+
+    // Load a model written by SaveCompressedFile(). Return false if the file
+    // is not a valid compressed mesh.
+    bool LoadFromCompressedFile(const std::wstring & filePath);
+
+    // Save the model as a compressed mesh, see CompressedMesh. Vertex
+    // positions are quantized, use GetMaxQuantizationError() to check that
+    // the result is still good enough. vt and vn indices are not saved.
+    bool SaveCompressedFile(const std::wstring & filePath) const;
+
+    // Upper bound of the distance in pixels between a vertex and its position
+    // after SaveCompressedFile() and LoadFromCompressedFile(), when drawn at
+    // scaleFactor into a width * height buffer.
+    double GetMaxQuantizationError(REAL scaleFactor,
+                                   INT32 width, INT32 height) const;
+
+    // Default tolerance of CleanupMesh(), relative to the diagonal of the
+    // bounding box.
+    static constexpr REAL DEFAULT_WELD_TOLERANCE = 1e-6f;
+
+    struct CleanupStats
+    {
+        UINT32 weldedVertices;  // merged into an earlier coincident vertex
+        UINT32 unusedVertices;  // not referenced by any face
+        UINT32 degenerateFaces;  // less than 3 distinct vertices, or no area
+        UINT32 duplicateFaces;  // same vertices as an earlier face
+    };
+
+    // Optional pass after loading: merge vertices closer than weldTolerance
+    // times the bounding box diagonal, remove degenerate faces and faces
+    // that repeat an earlier one with the same winding, and drop vertices no
+    // face refers to. Faces whose first three vertices are collinear are
+    // rotated to start at a proper corner, as the plane equation is taken
+    // from them. The bounding box is kept, so the model is still drawn at the
+    // same position and scale.
+    CleanupStats CleanupMesh(REAL weldTolerance = DEFAULT_WELD_TOLERANCE);
+
+    // Optional pass after loading: sort the faces along a Z-order curve over
+    // their centroids and renumber the vertices in order of first use, so
+    // that faces close in the table are close in space and the vertices
+    // read by InitTables() for consecutive faces are close in memory. The
+    // rendered image does not change.
+    void ReorderForLocality();
+
+    // threadCount: number of threads InitTables() builds the tables with, 0
+    //     (the default) means one per hardware thread for large models and
+    //     a single thread otherwise. The tables are the same for any
+    //     threadCount.
+    void SetTableThreadCount(UINT32 threadCount)
+    {
+        m_tableThreadCount = threadCount;
+    }
+
+    // Whether LoadFromObjFile() reads and writes the binary mesh cache of the
+    // obj file, enabled by default.
+    void SetMeshCacheEnabled(bool enabled) { m_useMeshCache = enabled; }
+
+    // Order in which the vertices of a face turned towards the viewer are
+    // seen by the viewer. Obj files normally list them counterclockwise.
+    enum class FrontFace { COUNTERCLOCKWISE, CLOCKWISE };
+
+    // Whether InitTables() drops the faces turned away from the viewer
+    // before setting up any edge, disabled by default. Only enable it for
+    // closed meshes whose faces all follow frontFace, the back faces of
+    // other models may be visible.
+    void SetBackFaceCulling(bool enabled,
+                            FrontFace frontFace = FrontFace::COUNTERCLOCKWISE);
+
+    // Number of faces dropped by back-face culling in the last frame drawn
+    // from scratch.
+    UINT32 GetCulledFaceCount() const { return m_culledFaceCount; }
+
+    // How GetBuffer() decides which face is in front at each pixel. Both
+    // draw the same image.
+    // DEPTH_BUFFER: the spans of every scan-line are drawn front to back
+    //     into a depth buffer, pixel by pixel where the coarse depth cannot
+    //     rule them out. The default, best for many small faces.
+    // SPANS: the spans of a scan-line are swept from left to right, and
+    //     between two span ends the front span is found from the depths at
+    //     the ends of the interval and filled without any depth test. Only
+    //     where spans cross are the pixels compared one by one. Best for a
+    //     few large faces that do not overlap much.
+    enum class RasterEngine { DEPTH_BUFFER, SPANS };
+
+    void SetRasterEngine(RasterEngine engine);
+
+    struct RasterStats
+    {
+        UINT64 pixelsTested;  // depth tests done
+        UINT64 pixelsWritten;  // depth tests passed, or pixels filled by SPANS
+        // Span pixels resolved a block at a time with no depth test: behind
+        // every pixel of a block of the coarse depth, or in front of all of
+        // them and written, which also counts in pixelsWritten. SPANS never
+        // skips, and counts the pixels of the intervals it fills without a
+        // test, a single span or a clear front span, as pixelsFilled.
+        UINT64 pixelsSkipped;
+        UINT64 pixelsFilled;
+    };
+
+    // Faces that won at least one pixel of the last frame drawn from
+    // scratch, in increasing order. A frame starts with these faces, the
+    // others are only drawn where the nearer ones leave room.
+    const std::vector<UINT32> & GetVisibleFaces() const
+    {
+        return m_shownFaces;
+    }
+
+    // Pixels drawn by the last GetBuffer(). pixelsTested / pixelsWritten
+    // is the overdraw left after the spans hidden by nearer ones were
+    // skipped block by block, and (pixelsSkipped + pixelsFilled) / (those
+    // plus pixelsTested) the part of the span pixels the coarse depth
+    // resolved.
+    const RasterStats & GetRasterStats() const { return m_rasterStats; }
 
     // scaleFactor: object scale factor, must be positive, 1 means original size
     // degreeX: rotate about x axis of object, mesured in degree
@@ -31,21 +176,167 @@ private:
 
     //std::vector<Position3R> m_vertexNormals;
 
+    // Copy of m_vertices as separate coordinate arrays for
+    // VertexTransform. Anything that changes m_vertices clears x,
+    // TransformModel() rebuilds it.
+    struct VertexArrays
+    {
+        std::vector<REAL> x;
+        std::vector<REAL> y;
+        std::vector<REAL> z;
+    };
+    VertexArrays m_vertexArrays;
+
     std::vector<Position3R> m_transformedVertices;
 
+    // Unit normal of every face from its first 3 vertices, as separate
+    // arrays for VertexTransform, or 0 for a face with no area. The model
+    // is only ever rotated and uniformly scaled, so TransformModel() just
+    // rotates these into m_transformedNormals and InitTables() needs no
+    // cross product or square root per face. Cleared with m_vertexArrays,
+    // TransformModel() rebuilds it with InitFaceNormals(). Only the
+    // normals of m_facesInView are rotated.
+    VertexArrays m_faceNormals;
+    std::vector<Position3R> m_transformedNormals;
+
+    void InitFaceNormals();
+
     // width: buffer width in pixel
     // height: buffer height in pixel
+    // area: part of the screen the tables are built for, see InitTables().
+    //     Only the faces that may reach into it are transformed when the
+    //     model has a face index.
     void TransformModel(INT32 width, INT32 height, REAL scaleFactor,
-                        REAL degreeX, REAL degreeY, REAL shiftX, REAL shiftY);
+                        REAL degreeX, REAL degreeY, REAL shiftX, REAL shiftY,
+                        const RECT & area);
 
-    struct FaceNode
+    // Texture vertex and vertex normal index of a face vertex, 0 if absent.
+    struct FaceAttributes
     {
-        int v;
         int vt;
         int vn;
     };
 
-    std::vector<std::vector<FaceNode>> m_faces;
+    // Faces in compressed sparse row form. The vertices of face i are
+    // vertices[offsets[i]] to vertices[offsets[i + 1] - 1], the first vertex
+    // is not repeated at the end. The attributes are only kept for the mesh
+    // cache and are never read while rendering, so they are stored apart.
+    struct FaceTable
+    {
+        std::vector<UINT32> offsets = std::vector<UINT32>(1, 0);
+        std::vector<int> vertices;  // vertex id of each face vertex
+        std::vector<FaceAttributes> attributes;  // parallel to vertices
+
+        size_t GetCount() const { return offsets.size() - 1; }
+    };
+
+    FaceTable m_faces;
+
+    // File order number of every face after ReorderForLocality(), empty
+    // while the faces are in file order. It is the rank of the face, so
+    // that depth ties are resolved as for the faces in file order.
+    std::vector<UINT32> m_faceIds;
+
+    // Edge adjacency: every undirected edge of the mesh is stored once in
+    // m_meshEdges, and m_faceEdges (parallel to m_faces.vertices) gives for
+    // each face vertex the edge from it to the next vertex of the face. An
+    // edge shared by two faces is thus set up once per frame. Anything that
+    // changes m_faces clears m_faceEdges, InitTables() rebuilds it.
+    struct MeshEdge
+    {
+        int v1;
+        int v2;
+    };
+    std::vector<MeshEdge> m_meshEdges;
+    std::vector<UINT32> m_faceEdges;
+
+    // Most edge pairs and chain nodes InitTables() may set up for the whole
+    // mesh and for a face, set up with m_faceEdges. A face convex in its
+    // plane is convex in every view, and gives one edge pair and a node for
+    // each edge. Any other simple face of n edges gives a pair for each
+    // vertex where it starts, ends, splits or joins, and at most 3n / 2 of
+    // them, and a node for the sides of each pair and each other edge.
+    struct TableBounds
+    {
+        size_t planes;
+        size_t chains;
+        UINT32 facePlanes;
+        UINT32 faceChains;
+        UINT32 faceSize;  // most vertices of a face
+    };
+    TableBounds m_tableBounds{0, 0, 0, 0, 0};
+
+    void InitEdgeAdjacency();
+
+    // Whether face pid is flat and strictly convex.
+    bool IsConvexFace(UINT32 pid) const;
+
+    // Models with fewer faces than this get no face index.
+    static constexpr UINT32 BVH_MIN_FACES = 1 << 10;
+    static constexpr UINT32 BVH_LEAF_FACES = 64;
+
+    // Face index: a bounding volume hierarchy over the faces in object
+    // space. The nodes are in depth-first order, and the faces and leaf
+    // vertices of every node are contiguous, so a whole subtree is taken
+    // or dropped at once. Anything that changes m_faces or m_vertices
+    // clears built, TransformModel() rebuilds it. Models with fewer than
+    // BVH_MIN_FACES faces are built with no nodes.
+    struct FaceBvh
+    {
+        struct Node
+        {
+            Position3R center;  // of the bounding box
+            Position3R extent;  // half of the size of the bounding box
+            UINT32 skip;  // next node after the subtree, this + 1 for leaves
+            UINT32 faceBegin;
+            UINT32 faceEnd;
+            UINT32 vertexBegin;
+            UINT32 vertexEnd;
+        };
+        std::vector<Node> nodes;
+        std::vector<UINT32> faces;  // face ids, leaf by leaf
+        // Every vertex used by the faces of each leaf, leaf by leaf, and a
+        // copy of their positions for VertexTransform.
+        std::vector<UINT32> vertexIds;
+        VertexArrays vertices;
+        VertexArrays normals;  // of faces, from m_faceNormals
+        bool built = false;
+    };
+    FaceBvh m_faceBvh;
+
+    void InitFaceBvh();
+    void BuildFaceBvh(UINT32 begin, UINT32 end,
+                      const std::vector<Position3R> & centers,
+                      std::vector<UINT32> & leafOfVertex);
+
+    // Faces InitTables() considers for the tables, all of them in order
+    // unless TransformVisibleFaces() dropped some.
+    std::vector<UINT32> m_facesInView;
+    bool m_allFacesVisible = true;
+
+    // Parts of m_faceBvh.vertexIds transformed by TransformVisibleFaces(),
+    // the other vertices are out of date.
+    struct Range
+    {
+        UINT32 begin;
+        UINT32 end;
+    };
+    std::vector<Range> m_vertexRuns;
+    std::vector<Position3R> m_runVertices;
+
+    // Same for the parts of m_faceBvh.faces whose normals are rotated.
+    std::vector<Range> m_faceRuns;
+    std::vector<Position3R> m_runNormals;
+
+    // Transform only the vertices of the faces in the leaves of m_faceBvh
+    // that may reach into area, rotate their normals by rotation, set
+    // m_facesInView to those faces and bounds to a bound of the whole
+    // model. Return false and do nothing if the whole model may reach into
+    // area.
+    bool TransformVisibleFaces(const Affine3x4R & transform,
+                               const Affine3x4R & rotation,
+                               const RECT & area,
+                               VertexTransform::Bounds & bounds);
 
     struct BoundingBox
     {
@@ -61,8 +352,70 @@ private:
     };
 
     BoundingBox m_box;
+
+    // Files smaller than this are not worth splitting across threads.
+    static constexpr size_t PARALLEL_LOAD_MIN_BYTES = 1 << 20;
+
+    // Part of an obj file that starts at a line beginning, parsed on its own.
+    struct ObjChunk
+    {
+        std::vector<Position3R> vertices;
+        FaceTable faces;
+        BoundingBox box;
+
+        struct Counts
+        {
+            int v;
+            int vt;
+            int vn;
+        } counts{0, 0, 0};  // only vt and vn are used, v is vertices.size()
+
+        // Face vertices whose index is relative to the first v (attribute 0),
+        // vt (1) or vn (2) of this chunk.
+        struct RelativeIndex
+        {
+            UINT32 node;  // position in faces.vertices
+            UINT32 attribute;
+        };
+        std::vector<RelativeIndex> relativeIndices;
+    };
+
+    static void ParseObjChunk(const char * begin, const char * end,
+                              ObjChunk & chunk);
+
+    // Copy the faces of source into target, which must already be resized
+    // to hold them, as faces faceFirst and up starting at vertex nodeFirst.
+    static void AppendFaces(const FaceTable & source, size_t faceFirst,
+                            size_t nodeFirst, FaceTable & target);
+
+    // Append the first count chunks, parsed from the part of the file right
+    // after the part already in m_vertices and m_faces, in parallel, and
+    // grow m_box by their boxes. total counts the vertices of the file up
+    // to the chunks, and is moved past them.
+    void AppendObjChunks(std::vector<ObjChunk> & chunks, UINT32 count,
+                         ObjChunk::Counts & total);
+
+    // Size of the pieces a file is parsed in by LoadFromObjFileProgressive().
+    static constexpr size_t PROGRESSIVE_SLICE_BYTES = 1 << 18;
+
+    bool m_useMeshCache = true;
+
+    // Return false if there is no valid cache for m_filePath.
+    bool LoadFromMeshCache();
+    void SaveMeshCache(const MeshCache::SourceInfo & source) const;
+
+    // Clear everything derived from m_faces and m_vertices, so that it is
+    // set up again for the changed mesh. Anything that changes the mesh
+    // calls it.
+    void InvalidateDerivedData();
+
+    void GetBoxArray(double box[6]) const;
     RECT m_boundingRect{ };
 
+    // Part of m_boundingRect the tables are built for, bottom and right
+    // included as in m_boundingRect. Empty if the model is out of view.
+    RECT m_tableRect{ };
+
     template <typename T = REAL>
     struct Plane
     {
@@ -72,47 +425,344 @@ private:
         T d;
     };
 
-    template <typename T>
-    static Plane<typename T::value_type> GetPlane(T p1, T p2, T p3);
-
+    // An edge pair of a face. Every scan-line crosses most faces twice,
+    // they have one pair. A face whose spans split or join, like a concave
+    // one, has a pair for every piece between those scan-lines.
     struct PlaneNode
     {
         Plane<REAL> plane;
-        UINT32 id;
-        UINT32 diffy;
+        UINT32 id;  // face index
+        UINT32 diffy;  // scan-lines of the pair
         Color color;
+        REAL zmin;  // depth of the nearest vertex of the face
+        UINT32 left;  // first nodes of the sides in m_edgeChains
+        UINT32 right;
     };
 
-    std::vector<std::vector<PlaneNode>> m_planes;
+    // Plane table in compressed sparse row form: the planes whose first
+    // scan-line is m_tableRect.top + i are planes[offsets[i]] to
+    // planes[offsets[i + 1] - 1], in activation order. Like the other
+    // tables it keeps its capacity, so once it is large enough a frame
+    // allocates nothing for it.
+    struct PlaneTable
+    {
+        std::vector<UINT32> offsets = std::vector<UINT32>(1, 0);
+        std::vector<PlaneNode> planes;
+
+        struct Row
+        {
+            const PlaneNode *first;
+            const PlaneNode *last;
+
+            const PlaneNode * begin() const { return first; }
+            const PlaneNode * end() const { return last; }
+        };
+
+        size_t GetRowCount() const { return offsets.size() - 1; }
+        UINT32 GetIndex(const PlaneNode & pl) const
+        {
+            return static_cast<UINT32>(&pl - planes.data());
+        }
+        Row GetRow(size_t i) const
+        {
+            return {planes.data() + offsets[i], planes.data() + offsets[i + 1]};
+        }
+    };
+
+    PlaneTable m_planes;
+
+    bool m_backFaceCulling = false;
+    FrontFace m_frontFace = FrontFace::COUNTERCLOCKWISE;
+    UINT32 m_culledFaceCount = 0;
+
+    // Scratch of InitTables() while culling: whether each face faces the
+    // viewer, and the elements of m_meshEdges that belong to the faces
+    // kept. m_edgeUsed is all zero between calls.
+    std::vector<UINT8> m_frontFacing;
+    std::vector<UINT8> m_edgeUsed;
+    std::vector<UINT32> m_usedEdges;
 
     struct EdgeNode
     {
         REAL xtop;
         REAL dx;
+        UINT32 diffy;  // 0 if the edge crosses no scan-line
+        INT32 topyi;  // first scan-line crossed
+    };
+
+    // One node per element of m_meshEdges. The edges of a plane are found
+    // through its face in m_faceEdges.
+    std::vector<EdgeNode> m_edges;
+
+    // A side of an edge pair is a chain of edges from the top down, set up
+    // with the plane table. A node is the part of an edge the side uses,
+    // next is the node below it, or NO_EDGE at the bottom of the pair.
+    struct EdgeChainNode
+    {
+        REAL x;  // at the first scan-line of the node
+        REAL dx;
         UINT32 diffy;
-        UINT32 planeId;
+        UINT32 next;
     };
+    std::vector<EdgeChainNode> m_edgeChains;
 
-    std::vector<std::vector<EdgeNode>> m_edges;
+    static constexpr UINT32 NO_EDGE = 0xFFFFFFFF;
 
+    // Only what is stepped or drawn on every scan-line. A finished edge is
+    // replaced by the next node of its side.
     struct ActiveEdgePairNode
     {
-        struct Edge
-        {
-            REAL x;
-            REAL dx;
-            UINT32 diffy;
-        } l, r;
+        EdgeChainNode l, r;
         REAL zl;
         REAL dzx;
         REAL dzy;
-        UINT32 planeId;
+        UINT32 plane;  // index into m_planes.planes
+        UINT32 rank;  // of the face, decides between equal depths
+        Color color;  // of the plane
     };
 
     Vector3R m_light{1.0f, 1.5f, 1.0f};  // Light direction vector
 
     Color m_planeColor = Color::WHITE;
 
-    // Initialize plane tables and edge tables.
-    void InitTables();
+    Color m_backgroundColor{30, 30, 30};
+
+    // Last frame of GetBuffer(). The tables are those of the frame drawn at
+    // shiftX and shiftY, the frame itself has since been moved by offsetX
+    // and offsetY pixels. Anything that changes the model clears valid.
+    struct FrameCache
+    {
+        bool valid = false;
+        INT32 width;
+        INT32 height;
+        REAL scaleFactor;
+        REAL degreeX;
+        REAL degreeY;
+        REAL shiftX = 0;
+        REAL shiftY = 0;
+        INT32 offsetX;
+        INT32 offsetY;
+        std::vector<std::vector<Color>> rows;
+    };
+
+    FrameCache m_frame;
+
+    RasterStats m_rasterStats{0, 0, 0, 0};
+
+    // The visible faces of GetVisibleFaces(), and a flag for each face.
+    // Anything that changes m_faces clears both.
+    std::vector<UINT32> m_shownFaces;
+    std::vector<UINT8> m_faceShown;
+
+    // Depth state of the whole frame in Rasterize(), and the face of every
+    // rank while m_faceIds is not empty. RasterizeByPlane() only uses
+    // m_depthBuffer and m_rankBuffer.
+    std::vector<REAL> m_depthBuffer;
+    std::vector<REAL> m_blockDepth;
+    std::vector<REAL> m_blockMinDepth;
+    std::vector<REAL> m_tileDepth;
+    std::vector<UINT32> m_rankBuffer;
+    std::vector<UINT32> m_rankFaces;
+
+    // Rank of the pixels no plane has won.
+    static constexpr UINT32 NO_RANK = 0xFFFFFFFF;
+
+    // Scratch of Rasterize(), RasterizeBySpans() and RasterizeByPlane().
+    std::vector<ActiveEdgePairNode> m_activeEdgePairs;
+
+    RasterEngine m_rasterEngine = RasterEngine::DEPTH_BUFFER;
+
+    // A span of the scan-line drawn by RasterizeBySpans(), clamped to
+    // columns xbegin to xend. The depth of a pixel is computed as in
+    // DrawSpan(), from the unclamped left end xl, and is within slack of
+    // the plane.
+    struct RowSpan
+    {
+        INT32 xl;
+        INT32 xbegin;
+        INT32 xend;
+        REAL zl;
+        REAL dzx;
+        REAL slack;
+        UINT32 rank;
+        UINT32 face;
+        Color color;
+    };
+
+    // Spans of the current scan-line from left to right, and the ones
+    // covering the interval being drawn.
+    std::vector<RowSpan> m_rowSpans;
+    std::vector<UINT32> m_coveringSpans;
+
+    // Intervals where the front span is not clear are halved down to this
+    // width in pixels before their pixels are compared one by one.
+    static constexpr INT32 MIN_SPAN_INTERVAL = 8;
+
+    // Width in pixels of the blocks and tiles of the coarse depth buffer
+    // of Rasterize(). It keeps for every block of a scan-line the largest
+    // and a lower bound of the depths in it, and for every tile of
+    // COARSE_DEPTH_TILE / COARSE_DEPTH_BLOCK blocks the largest depth. A
+    // span behind a tile or a block skips it whole, a span in front of a
+    // block is written to it without depth tests.
+    static constexpr INT32 COARSE_DEPTH_BLOCK = 16;
+    static constexpr INT32 COARSE_DEPTH_TILE = 64;
+
+    // Depth state of a scan-line, starting at column rect.left of
+    // DrawSpan(): for every pixel the depth and the rank of the span that
+    // won it, an equal depth goes to the lower rank whatever order the
+    // spans are drawn in. Rasterize() draws the spans of a row front to
+    // back, so it also keeps the coarse depth, which is null otherwise.
+    struct DepthRow
+    {
+        REAL *depth;
+        REAL *blocks;  // largest depth of each block
+        REAL *blockMins;
+        REAL *tiles;
+        UINT32 *ranks;
+    };
+
+    // Pans further than this in pixels are drawn from scratch, so that the
+    // offsets stay far away from overflowing.
+    static constexpr REAL MAX_PAN = 1 << 24;
+
+    // The tables of a frame cover the frame and this fraction of its width
+    // and height on every side, so that short pans of a model larger than
+    // the frame need no new tables.
+    static constexpr INT32 PAN_MARGIN_DIVISOR = 4;
+
+    // Initialize plane tables and edge tables for the pixels of area. Faces
+    // and edges are clipped to it, so the size of the tables depends on the
+    // size of area and not on the zoom.
+    void InitTables(const RECT & area);
+
+    // Set up m_edges[eid] for the rows of the tables.
+    void InitEdge(size_t eid);
+
+    struct TablePart;
+
+    // Add the edge pairs of face pid to part, unless the face is not
+    // drawn. The edges of the face must be set up.
+    void InitPlane(UINT32 pid, bool clipColumns, REAL lightN,
+                   TablePart & part) const;
+
+    // Add to part the edge pairs of face pn.id, whose plane covers the
+    // scan-lines topyi to btmyi.
+    void AddEdgePairs(const PlaneNode & pn, INT32 topyi, INT32 btmyi,
+                      TablePart & part) const;
+
+    UINT32 m_tableThreadCount = 0;
+
+    // Fewer faces than this per thread are not worth splitting.
+    static constexpr size_t PARALLEL_TABLE_MIN_FACES = 1 << 13;
+
+    // An edge pair AddEdgePairs() has not closed yet.
+    struct OpenEdgePair
+    {
+        UINT32 plane;  // in TablePart::planes
+        INT32 ytop;
+        UINT32 l;  // edges of the sides
+        UINT32 r;
+        UINT32 lnode;  // last nodes of the sides
+        UINT32 rnode;
+        INT32 lytop;  // first scan-lines of lnode and rnode
+        INT32 rytop;
+    };
+
+    // Planes set up by one thread of InitTables(), with the row of each,
+    // and the edge chains they start. rowCounts first counts the planes of
+    // each row, then gives where the next one of the row goes in
+    // m_planes.planes. chainBase is where chains goes in m_edgeChains.
+    struct TablePart
+    {
+        std::vector<PlaneNode> planes;
+        std::vector<UINT32> rows;
+        std::vector<UINT32> rowCounts;
+        std::vector<EdgeChainNode> chains;
+        UINT32 chainBase;
+
+        // Scratch of AddEdgePairs().
+        std::vector<EdgeNode> edges;
+        std::vector<INT32> events;
+        std::vector<UINT32> active;
+        std::vector<OpenEdgePair> open;
+        std::vector<OpenEdgePair> kept;
+    };
+    std::vector<TablePart> m_tableParts;
+
+    // Reserve the tables, m_tableParts and the scratch of Rasterize() and
+    // RasterizeBySpans() for the most any view of the model may need in
+    // area, so that no frame after the first allocates. Only faces whose
+    // edges make several edge pairs may need more.
+    void ReserveFrameScratch(const RECT & area);
+
+    // Move the last frame by dx and dy pixels and draw the strips that
+    // moved in with RasterizeByPlane().
+    void PanFrame(INT32 dx, INT32 dy);
+
+    // Draw rect of m_frame from the tables, scan-line by scan-line.
+    void Rasterize(const RECT & rect);
+
+    // Same as Rasterize(), resolving the depths span by span, see
+    // RasterEngine::SPANS.
+    void RasterizeBySpans(const RECT & rect);
+
+    // Draw columns x1 to x2 - 1 of a scan-line of RasterizeBySpans(), which
+    // are covered by the count spans of m_rowSpans at covering and by no
+    // other. frameRow points at column 0 of the tables.
+    void DrawInterval(INT32 x1, INT32 x2, const UINT32 * covering,
+                      size_t count, Color * frameRow, RasterStats & stats);
+
+    // Draw rect of m_frame from the tables plane by plane, skipping the
+    // planes that do not reach into it. Gives the same pixels as
+    // Rasterize(), but costs little more than the planes drawn when rect is
+    // a thin strip.
+    void RasterizeByPlane(const RECT & rect);
+
+    // Draw plane pl, whose first scan-line is ytop, into frameRect of
+    // m_frame the way Rasterize() would. rows is the depth state of the
+    // first row of frameRect, the others follow it, and blockCount is the
+    // number of blocks of a row. The tiles of a row are as many as
+    // GetTileCount(blockCount).
+    void DrawPlane(const PlaneNode & pl, INT32 ytop,
+                   const RECT & frameRect, const DepthRow & rows,
+                   INT32 blockCount);
+
+    static INT32 GetTileCount(INT32 blockCount)
+    {
+        constexpr INT32 blocksPerTile = COARSE_DEPTH_TILE / COARSE_DEPTH_BLOCK;
+        return (blockCount + blocksPerTile - 1) / blocksPerTile;
+    }
+
+    // Columns, in the coordinates of the tables, that plane may cover.
+    struct PlaneColumns
+    {
+        INT32 left;
+        INT32 right;
+    };
+
+    // Indexed by face index, filled on demand by InitPlaneColumns().
+    std::vector<PlaneColumns> m_planeColumns;
+
+    void InitPlaneColumns();
+
+    // Rank of face pid, its place among the faces in file order.
+    UINT32 GetFaceRank(UINT32 pid) const
+    {
+        return m_faceIds.empty() ? pid : m_faceIds[pid];
+    }
+
+    // Set epn to the edge pair pl at its first scan-line y.
+    void StartEdgePair(const PlaneNode & pl, INT32 y,
+                       ActiveEdgePairNode & epn) const;
+
+    // Move epn from scan-line y to the next one. Return false when the
+    // pair ends there.
+    bool StepEdgePair(ActiveEdgePairNode & epn, INT32 y) const;
+
+    // Draw the part of the span of epn inside the columns of rect.
+    // frameRow starts at column rect.left. A null color only updates the
+    // depth.
+    void DrawSpan(const ActiveEdgePairNode & epn, const Color * color,
+                  const RECT & rect, Color * frameRow, const DepthRow & row,
+                  RasterStats & stats) const;
 };
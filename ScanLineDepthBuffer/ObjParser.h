@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdlib>  // std::strtof() std::strtod()
+#include "Types.h"
+
+/*
+ * Allocation-free tokenizer for obj text, working in place on a character
+ * range [p, end) that need not be null-terminated (e.g. a mapped file).
+ *
+ * All Parse* functions advance p past what they consumed and return false
+ * without consuming anything when there is no valid token at p.
+ */
+class ObjParser
+{
+public:
+    // Line breaks are not blanks, since obj statements end at the line end.
+    static bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+    static void SkipBlanks(const char *& p, const char * end)
+    {
+        while (p != end && IsBlank(*p)) ++p;
+    }
+
+    // Move p to the first character of the next line.
+    static void SkipLine(const char *& p, const char * end)
+    {
+        while (p != end && *p++ != '\n') { }
+    }
+
+    // Return true if p is at the end of a statement, i.e. at a line break, a
+    // comment or the end of range. Blanks should be skipped before.
+    static bool IsStatementEnd(const char * p, const char * end)
+    {
+        return p == end || *p == '\n' || *p == '#';
+    }
+
+    // Match keyword at p, it must be followed by a blank or statement end.
+    static bool MatchKeyword(const char *& p, const char * end,
+                             const char * keyword)
+    {
+        const char *q = p;
+        while (*keyword)
+        {
+            if (q == end || *q != *keyword) return false;
+            ++q;
+            ++keyword;
+        }
+        if (q != end && !IsBlank(*q) && *q != '\n') return false;
+        p = q;
+        return true;
+    }
+
+    // Parse a decimal integer with optional sign.
+    static bool ParseInt(const char *& p, const char * end, int & value)
+    {
+        const char *q = p;
+        bool negative = false;
+        if (q != end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+        if (q == end || !IsDigit(*q)) return false;
+        int v = 0;
+        while (q != end && IsDigit(*q)) v = v * 10 + (*q++ - '0');
+        value = negative ? -v : v;
+        p = q;
+        return true;
+    }
+
+    // Parse a decimal floating point number like "-1.25e-3".
+    //
+    // Numbers with at most as many significant digits as REAL can hold
+    // exactly and a small exponent (which covers nearly every number written
+    // by common exporters) are converted with a single correctly rounded
+    // multiplication or division, so the result is the same as strtof().
+    // The rest fall back to the C library on a copy of the token.
+    static bool ParseReal(const char *& p, const char * end, REAL & value)
+    {
+        const char *q = p;
+        bool negative = false;
+        if (q != end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+
+        unsigned long long mantissa = 0;
+        int digits = 0;  // significant digits stored in mantissa
+        int exponent = 0;
+        bool anyDigit = false;
+        bool exact = true;
+
+        for (; q != end && IsDigit(*q); ++q)
+        {
+            anyDigit = true;
+            AddDigit(mantissa, digits, exponent, exact, *q, false);
+        }
+        if (q != end && *q == '.')
+        {
+            for (++q; q != end && IsDigit(*q); ++q)
+            {
+                anyDigit = true;
+                AddDigit(mantissa, digits, exponent, exact, *q, true);
+            }
+        }
+        if (!anyDigit) return false;
+
+        if (q != end && (*q == 'e' || *q == 'E'))
+        {
+            const char *e = q + 1;
+            int exp10;
+            if (ParseInt(e, end, exp10))
+            {
+                exponent += exp10;
+                q = e;
+            }
+        }
+
+        if (mantissa == 0)
+        {
+            value = negative ? -static_cast<REAL>(0) : static_cast<REAL>(0);
+        }
+        else if (exact && mantissa <= MAX_EXACT_MANTISSA &&
+                 exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10)
+        {
+            REAL m = static_cast<REAL>(mantissa);
+            value = exponent < 0 ? m / Pow10(-exponent) : m * Pow10(exponent);
+            if (negative) value = -value;
+        }
+        else
+        {
+            char buf[64];
+            size_t len = q - p;
+            if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+            for (size_t i = 0; i != len; ++i) buf[i] = p[i];
+            buf[len] = '\0';
+            value = StrToReal(buf);
+        }
+
+        p = q;
+        return true;
+    }
+
+private:
+#ifndef DOUBLE_PRECISION
+    static constexpr unsigned long long MAX_EXACT_MANTISSA = 1ull << 24;
+    static constexpr int MAX_EXACT_POW10 = 10;
+    static REAL StrToReal(const char * s) { return std::strtof(s, nullptr); }
+#else
+    static constexpr unsigned long long MAX_EXACT_MANTISSA = 1ull << 53;
+    static constexpr int MAX_EXACT_POW10 = 22;
+    static REAL StrToReal(const char * s) { return std::strtod(s, nullptr); }
+#endif
+
+    // Powers of ten, n must not exceed MAX_EXACT_POW10 so that the result is
+    // exactly representable in REAL.
+    static REAL Pow10(int n)
+    {
+        static const double table[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        return static_cast<REAL>(table[n]);
+    }
+
+    static void AddDigit(unsigned long long & mantissa, int & digits,
+                         int & exponent, bool & exact, char c, bool fraction)
+    {
+        // Leading zeros are not significant.
+        if (digits == 0 && c == '0')
+        {
+            if (fraction) --exponent;
+            return;
+        }
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (c - '0');
+            ++digits;
+            if (fraction) --exponent;
+        }
+        else
+        {
+            // Too many digits to hold, drop them and let the C library
+            // round the original text.
+            exact = false;
+            if (!fraction) ++exponent;
+        }
+    }
+};
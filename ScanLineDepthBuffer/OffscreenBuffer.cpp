@@ -1,5 +1,6 @@
 ﻿#include <cstdlib>  // std::abort
 #include <cassert>
+#include <cstring>  // std::memcmp()
 #include "OffscreenBuffer.h"
 #include "DebugPrint.h"
 
@@ -50,6 +51,13 @@ void OffscreenBuffer::SetRow(INT32 y, const std::vector<Color> & row)
         *pixel++ = c.GetColorCode();
 }
 
+bool OffscreenBuffer::IsSameImage(const OffscreenBuffer & other) const
+{
+    return m_width == other.m_width && m_height == other.m_height &&
+           (m_height == 0 ||
+            std::memcmp(m_memory, other.m_memory, m_height * m_pitch) == 0);
+}
+
 void OffscreenBuffer::OnPaint(HDC hdc, INT32 width, INT32 height)
 {
     StretchDIBits(hdc, 0, 0, width, height, 0, 0, m_width, m_height,
@@ -22,6 +22,9 @@ public:
     INT32 GetWidth() const { return m_width; }
     INT32 GetHeight() const { return m_height; }
 
+    // Whether other has the same size and pixels.
+    bool IsSameImage(const OffscreenBuffer & other) const;
+
 private:
     // Memory Layout:
     //     From top to bottom, from left to right.
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Types.h"
+
+/*
+ * Minimal fork-join helpers on top of std::thread.
+ */
+class Parallel
+{
+public:
+    // Number of hardware threads, at least 1.
+    static UINT32 GetThreadCount()
+    {
+        UINT32 n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    // Call fn(i) for every i in [0, count), each on its own thread, and
+    // return when all calls are done. Task 0 runs on the calling thread.
+    // The other tasks run on worker threads kept between calls, so once
+    // they are started a call allocates nothing. A call made while the
+    // workers are busy, from another thread or from a task, starts threads
+    // of its own.
+    template <typename F>
+    static void For(UINT32 count, const F & fn)
+    {
+        if (count == 0) return;
+        if (count == 1)
+        {
+            fn(0);
+            return;
+        }
+        Workers &workers = GetWorkers();
+        if (!workers.busy.exchange(true))
+        {
+            workers.Run(count, &Call<F>, &fn);
+            workers.busy = false;
+            return;
+        }
+        std::vector<std::thread> threads;
+        threads.reserve(count - 1);
+        for (UINT32 i = 1; i < count; ++i)
+            threads.emplace_back([&fn, i]() { fn(i); });
+        fn(0);
+        for (auto &t : threads)
+            t.join();
+    }
+
+private:
+    typedef void (*Task)(const void * fn, UINT32 i);
+
+    template <typename F>
+    static void Call(const void * fn, UINT32 i)
+    {
+        (*static_cast<const F *>(fn))(i);
+    }
+
+    // Worker i runs task i of every call with more than i tasks. Workers
+    // are started when a call first needs them.
+    class Workers
+    {
+    public:
+        std::atomic<bool> busy{false};
+
+        ~Workers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_start.notify_all();
+            for (auto &t : m_threads)
+                t.join();
+        }
+
+        void Run(UINT32 count, Task task, const void * fn)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_threads.size() + 1 < count)
+            {
+                const UINT32 i = static_cast<UINT32>(m_threads.size() + 1);
+                const UINT32 seen = m_generation;
+                m_threads.emplace_back([this, i, seen]() { Work(i, seen); });
+            }
+            m_task = task;
+            m_fn = fn;
+            m_count = count;
+            m_running = count - 1;
+            ++m_generation;
+            lock.unlock();
+            m_start.notify_all();
+
+            task(fn, 0);
+
+            lock.lock();
+            m_done.wait(lock, [this]() { return m_running == 0; });
+        }
+
+    private:
+        void Work(UINT32 i, UINT32 seen)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;)
+            {
+                m_start.wait(lock, [&]()
+                {
+                    return m_stop || m_generation != seen;
+                });
+                if (m_stop) return;
+                seen = m_generation;
+                if (i >= m_count) continue;
+
+                const Task task = m_task;
+                const void *fn = m_fn;
+                lock.unlock();
+                task(fn, i);
+                lock.lock();
+                if (--m_running == 0) m_done.notify_one();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        std::vector<std::thread> m_threads;
+        Task m_task = nullptr;
+        const void *m_fn = nullptr;
+        UINT32 m_count = 0;
+        UINT32 m_running = 0;
+        UINT32 m_generation = 0;
+        bool m_stop = false;
+    };
+
+    static Workers &GetWorkers()
+    {
+        static Workers workers;
+        return workers;
+    }
+};
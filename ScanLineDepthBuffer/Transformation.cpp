@@ -1,25 +1,21 @@
 #include <cmath>
 #include "Transformation.h"
 
-Matrix4x4R Transformation::Translate(Vector3R v)
+Affine3x4R Transformation::Translate(Vector3R v)
 {
-    REAL t[4][4] = {{1, 0, 0, v.x},
-                    {0, 1, 0, v.y},
-                    {0, 0, 1, v.z},
-                    {0, 0, 0,   1}};
-    return t;
+    return Affine3x4R{{{1, 0, 0, v.x},
+                       {0, 1, 0, v.y},
+                       {0, 0, 1, v.z}}};
 }
 
-Matrix4x4R Transformation::Translate(REAL x, REAL y, REAL z)
+Affine3x4R Transformation::Translate(REAL x, REAL y, REAL z)
 {
-    REAL t[4][4] = {{1, 0, 0, x},
-                    {0, 1, 0, y},
-                    {0, 0, 1, z},
-                    {0, 0, 0, 1}};
-    return t;
+    return Affine3x4R{{{1, 0, 0, x},
+                       {0, 1, 0, y},
+                       {0, 0, 1, z}}};
 }
 
-//Matrix4x4R Transformation::Rotate(Vector3R axis, REAL angle)
+//Affine3x4R Transformation::Rotate(Vector3R axis, REAL angle)
 //{
 //    REAL lentr = 1.0f / std::sqrt(axis.y * axis.y + axis.z * axis.z);
 //    REAL len = 1.0f / std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
@@ -30,67 +26,55 @@ Matrix4x4R Transformation::Translate(REAL x, REAL y, REAL z)
 //    return t;
 //}
 
-Matrix4x4R Transformation::RotateAboutXAxis(REAL angle)
+Affine3x4R Transformation::RotateAboutXAxis(REAL angle)
 {
     constexpr REAL PI = 3.14159265358979323846f;
     REAL theta = angle * PI / 180;
     REAL costheta = std::cos(theta);
     REAL sintheta = std::sin(theta);
-    REAL t[4][4] = {{1, 0, 0, 0},
-                    {0, costheta, sintheta, 0},
-                    {0, -sintheta, costheta, 0},
-                    {0, 0, 0, 1}};
-    return t;
+    return Affine3x4R{{{1, 0, 0, 0},
+                       {0, costheta, sintheta, 0},
+                       {0, -sintheta, costheta, 0}}};
 }
 
-Matrix4x4R Transformation::RotateAboutYAxis(REAL angle)
+Affine3x4R Transformation::RotateAboutYAxis(REAL angle)
 {
     constexpr REAL PI = 3.14159265358979323846f;
     REAL theta = angle * PI / 180;
     REAL costheta = std::cos(theta);
     REAL sintheta = std::sin(theta);
-    REAL t[4][4] = {{costheta, 0, -sintheta, 0},
-                    {0, 1, 0, 0},
-                    {sintheta, 0, costheta, 0},
-                    {0, 0, 0, 1}};
-    return t;
+    return Affine3x4R{{{costheta, 0, -sintheta, 0},
+                       {0, 1, 0, 0},
+                       {sintheta, 0, costheta, 0}}};
 }
 
-Matrix4x4R Transformation::Scale(REAL s)
+Affine3x4R Transformation::Scale(REAL s)
 {
-    REAL t[4][4] = {{s, 0, 0, 0},
-                    {0, s, 0, 0},
-                    {0, 0, s, 0},
-                    {0, 0, 0, 1}};
-    return t;
+    return Affine3x4R{{{s, 0, 0, 0},
+                       {0, s, 0, 0},
+                       {0, 0, s, 0}}};
 }
 
-Matrix4x4R Transformation::Scale(Vector3R v)
+Affine3x4R Transformation::Scale(Vector3R v)
 {
-    REAL t[4][4] = {{v.x,   0,   0, 0},
-                    {  0, v.y,   0, 0},
-                    {  0,   0, v.z, 0},
-                    {  0,   0,   0, 1}};
-    return t;
+    return Affine3x4R{{{v.x,   0,   0, 0},
+                       {  0, v.y,   0, 0},
+                       {  0,   0, v.z, 0}}};
 }
 
-Matrix4x4R Transformation::Scale(REAL sx, REAL sy, REAL sz)
+Affine3x4R Transformation::Scale(REAL sx, REAL sy, REAL sz)
 {
-    REAL t[4][4] = {{sx,  0,  0, 0},
-                    { 0, sy,  0, 0},
-                    { 0,  0, sz, 0},
-                    { 0,  0,  0, 1}};
-    return t;
+    return Affine3x4R{{{sx,  0,  0, 0},
+                       { 0, sy,  0, 0},
+                       { 0,  0, sz, 0}}};
 }
 
-Matrix4x4R Transformation::Symmetry(bool xoy, bool yoz, bool xoz)
+Affine3x4R Transformation::Symmetry(bool xoy, bool yoz, bool xoz)
 {
     REAL x = yoz ? -1.0f : 1.0f;
     REAL y = xoz ? -1.0f : 1.0f;
     REAL z = xoy ? -1.0f : 1.0f;
-    REAL t[4][4] = {{x, 0, 0, 0},
-                    {0, y, 0, 0},
-                    {0, 0, z, 0},
-                    {0, 0, 0, 1}};
-    return t;
+    return Affine3x4R{{{x, 0, 0, 0},
+                       {0, y, 0, 0},
+                       {0, 0, z, 0}}};
 }
\ No newline at end of file
@@ -49,18 +49,16 @@ protected:
 template <typename T, size_t N>
 class Matrix;
 
+// Plain aggregate like Ternion, so that it is trivially copyable and 4
+// REALs in size.
 template <typename T>
-struct Quaternion : public Tuple<T, 4>
+struct Quaternion
 {
-    template <typename U>
-    friend Quaternion<U> operator*(const Matrix<U, 4> & lhs,
-                                   const Quaternion<U> & rhs);
-
-    using Tuple::Tuple;
-    T &x = val[0];
-    T &y = val[1];
-    T &z = val[2];
-    T &w = val[3];
+    using value_type = T;
+    T x;
+    T y;
+    T z;
+    T w;
 };
 
 using Vector4R = Quaternion<REAL>;
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 typedef unsigned char UINT8;
+typedef unsigned short UINT16;
 typedef unsigned int UINT32;
 
 typedef signed int INT32;
@@ -0,0 +1,168 @@
+#include <vector>
+#include <intrin.h>  // __cpuid() _xgetbv()
+#include <emmintrin.h>  // SSE2
+#include "VertexTransform.h"
+#include "Parallel.h"
+
+static_assert(sizeof(Position3R) == 3 * sizeof(REAL),
+              "Position3R must be packed for the interleaved stores");
+
+static bool IsAvxSupported()
+{
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) { return false; }
+
+    // The operating system must also save the YMM registers.
+    return (_xgetbv(0) & 6) == 6;
+}
+
+bool VertexTransform::IsAvxUsed()
+{
+#ifndef DOUBLE_PRECISION
+    static const bool avx = IsAvxSupported();
+    return avx;
+#else
+    return false;
+#endif
+}
+
+VertexTransform::Bounds VertexTransform::Transform(
+    const Affine3x4R & transform, const REAL * x, const REAL * y,
+    const REAL * z, size_t count, Position3R * out)
+{
+#ifndef DOUBLE_PRECISION
+    const auto kernel = IsAvxUsed() ? &TransformAvx : &TransformSse;
+#else
+    const auto kernel = &TransformTail;
+#endif
+
+    UINT32 threadCount = Parallel::GetThreadCount();
+    if (threadCount > count / PARALLEL_MIN_VERTICES)
+    {
+        threadCount = static_cast<UINT32>(count / PARALLEL_MIN_VERTICES);
+    }
+    if (threadCount <= 1)
+    {
+        Bounds bounds;
+        kernel(transform, x, y, z, count, out, bounds);
+        return bounds;
+    }
+
+    // Every thread but the last gets a multiple of 8 vertices, so only the
+    // last one runs the scalar tail.
+    const size_t blockSize = (count / threadCount + 7) &
+                             ~static_cast<size_t>(7);
+    std::vector<Bounds> bounds(threadCount);
+    Parallel::For(threadCount, [&](UINT32 i)
+    {
+        size_t first = blockSize * i;
+        if (first >= count) { return; }
+        size_t n = count - first < blockSize ? count - first : blockSize;
+        kernel(transform, x + first, y + first, z + first, n, out + first,
+               bounds[i]);
+    });
+
+    Bounds result = bounds[0];
+    for (UINT32 i = 1; i < threadCount; ++i)
+    {
+        if (bounds[i].left < result.left) result.left = bounds[i].left;
+        if (bounds[i].right > result.right) result.right = bounds[i].right;
+        if (bounds[i].top < result.top) result.top = bounds[i].top;
+        if (bounds[i].bottom > result.bottom) result.bottom = bounds[i].bottom;
+    }
+    return result;
+}
+
+void VertexTransform::TransformTail(const Affine3x4R & t, const REAL * x,
+                                    const REAL * y, const REAL * z,
+                                    size_t count, Position3R * out,
+                                    Bounds & bounds)
+{
+    for (size_t i = 0; i != count; ++i)
+    {
+        Position3R p = t * Position3R{x[i], y[i], z[i]};
+        if (p.x < bounds.left) bounds.left = p.x;
+        if (p.x > bounds.right) bounds.right = p.x;
+        if (p.y < bounds.top) bounds.top = p.y;
+        if (p.y > bounds.bottom) bounds.bottom = p.y;
+        out[i] = p;
+    }
+}
+
+#ifndef DOUBLE_PRECISION
+
+void VertexTransform::TransformSse(const Affine3x4R & t, const REAL * x,
+                                   const REAL * y, const REAL * z,
+                                   size_t count, Position3R * out,
+                                   Bounds & bounds)
+{
+    __m128 row[3][4];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+        {
+            row[i][j] = _mm_set1_ps(t.m[i][j]);
+        }
+
+    __m128 left = _mm_set1_ps(bounds.left);
+    __m128 right = _mm_set1_ps(bounds.right);
+    __m128 top = _mm_set1_ps(bounds.top);
+    __m128 bottom = _mm_set1_ps(bounds.bottom);
+
+    const size_t simdCount = count & ~static_cast<size_t>(3);
+    for (size_t i = 0; i != simdCount; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+
+        __m128 tx[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            tx[k] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(row[k][0], vx), _mm_mul_ps(row[k][1], vy)),
+                        _mm_mul_ps(row[k][2], vz)), row[k][3]);
+        }
+
+        left = _mm_min_ps(left, tx[0]);
+        right = _mm_max_ps(right, tx[0]);
+        top = _mm_min_ps(top, tx[1]);
+        bottom = _mm_max_ps(bottom, tx[1]);
+
+        // Interleave to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3.
+        __m128 xy01 = _mm_unpacklo_ps(tx[0], tx[1]);
+        __m128 xy23 = _mm_unpackhi_ps(tx[0], tx[1]);
+        __m128 yz01 = _mm_unpacklo_ps(tx[1], tx[2]);
+        __m128 yz23 = _mm_unpackhi_ps(tx[1], tx[2]);
+        __m128 zx01 = _mm_shuffle_ps(tx[2], tx[0], _MM_SHUFFLE(1, 1, 0, 0));
+        __m128 zx23 = _mm_shuffle_ps(tx[2], tx[0], _MM_SHUFFLE(3, 3, 2, 2));
+        REAL *dst = &out[i].x;
+        _mm_storeu_ps(dst, _mm_shuffle_ps(xy01, zx01,
+                                          _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz01, xy23,
+                                              _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx23, yz23,
+                                              _MM_SHUFFLE(3, 2, 2, 0)));
+    }
+
+    REAL lane[4];
+    _mm_storeu_ps(lane, left);
+    for (int k = 0; k < 4; ++k)
+        if (lane[k] < bounds.left) bounds.left = lane[k];
+    _mm_storeu_ps(lane, right);
+    for (int k = 0; k < 4; ++k)
+        if (lane[k] > bounds.right) bounds.right = lane[k];
+    _mm_storeu_ps(lane, top);
+    for (int k = 0; k < 4; ++k)
+        if (lane[k] < bounds.top) bounds.top = lane[k];
+    _mm_storeu_ps(lane, bottom);
+    for (int k = 0; k < 4; ++k)
+        if (lane[k] > bounds.bottom) bounds.bottom = lane[k];
+
+    TransformTail(t, x + simdCount, y + simdCount, z + simdCount,
+                  count - simdCount, out + simdCount, bounds);
+}
+
+#endif  // !DOUBLE_PRECISION
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cfloat>  // FLT_MAX FLT_MIN
+#include "Types.h"
+#include "Tuple.h"  // Position3R
+#include "Affine.h"
+
+/*
+ * Batch affine transform of vertex positions kept as separate x, y and z
+ * arrays (structure of arrays), so that 4 or 8 vertices are transformed
+ * per instruction. The AVX kernel is used when the processor and the
+ * operating system support it, the SSE kernel otherwise. Large batches are
+ * split across threads.
+ *
+ * Every kernel does the same operations in the same order as
+ * Affine3x4R * Position3R, so the result does not depend on the kernel.
+ */
+class VertexTransform
+{
+public:
+    // Bounds of the transformed x and y coordinates. Initialized like the
+    // scalar loop did, i.e. right and bottom start at REAL_MIN.
+    struct Bounds
+    {
+        REAL left = REAL_MAX;
+        REAL right = REAL_MIN;
+        REAL top = REAL_MAX;
+        REAL bottom = REAL_MIN;
+    };
+
+    // out[i] = transform * (x[i], y[i], z[i], 1) for i in [0, count), and
+    // return the bounds of the transformed x and y in the same pass.
+    static Bounds Transform(const Affine3x4R & transform, const REAL * x,
+                            const REAL * y, const REAL * z, size_t count,
+                            Position3R * out);
+
+    // Whether Transform() uses the AVX kernel on this machine.
+    static bool IsAvxUsed();
+
+private:
+    // Batches smaller than this are not worth splitting across threads.
+    static constexpr size_t PARALLEL_MIN_VERTICES = 1 << 16;
+
+    static void TransformSse(const Affine3x4R & transform, const REAL * x,
+                             const REAL * y, const REAL * z, size_t count,
+                             Position3R * out, Bounds & bounds);
+
+    // Defined in VertexTransformAvx.cpp, which is compiled for AVX.
+    static void TransformAvx(const Affine3x4R & transform, const REAL * x,
+                             const REAL * y, const REAL * z, size_t count,
+                             Position3R * out, Bounds & bounds);
+
+    // Scalar transform of the last count % 4 (or % 8) vertices.
+    static void TransformTail(const Affine3x4R & transform, const REAL * x,
+                              const REAL * y, const REAL * z, size_t count,
+                              Position3R * out, Bounds & bounds);
+};
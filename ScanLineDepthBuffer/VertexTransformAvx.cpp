@@ -0,0 +1,89 @@
+// This file is compiled with /arch:AVX. It must not use the standard
+// library, since inline functions instantiated here could be picked by the
+// linker for the rest of the program and run on processors without AVX.
+
+#include <immintrin.h>  // AVX
+#include "VertexTransform.h"
+
+#ifndef DOUBLE_PRECISION
+
+void VertexTransform::TransformAvx(const Affine3x4R & t, const REAL * x,
+                                   const REAL * y, const REAL * z,
+                                   size_t count, Position3R * out,
+                                   Bounds & bounds)
+{
+    __m256 row[3][4];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+        {
+            row[i][j] = _mm256_set1_ps(t.m[i][j]);
+        }
+
+    __m256 left = _mm256_set1_ps(bounds.left);
+    __m256 right = _mm256_set1_ps(bounds.right);
+    __m256 top = _mm256_set1_ps(bounds.top);
+    __m256 bottom = _mm256_set1_ps(bounds.bottom);
+
+    const size_t simdCount = count & ~static_cast<size_t>(7);
+    for (size_t i = 0; i != simdCount; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        __m256 vz = _mm256_loadu_ps(z + i);
+
+        __m256 tx[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            tx[k] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(row[k][0], vx),
+                        _mm256_mul_ps(row[k][1], vy)),
+                        _mm256_mul_ps(row[k][2], vz)), row[k][3]);
+        }
+
+        left = _mm256_min_ps(left, tx[0]);
+        right = _mm256_max_ps(right, tx[0]);
+        top = _mm256_min_ps(top, tx[1]);
+        bottom = _mm256_max_ps(bottom, tx[1]);
+
+        // Interleave each 128-bit half as in TransformSse(), which gives
+        // the 12 floats of vertices 0 to 3 in the low halves of o0 o1 o2
+        // and those of vertices 4 to 7 in the high halves.
+        __m256 xy01 = _mm256_unpacklo_ps(tx[0], tx[1]);
+        __m256 xy23 = _mm256_unpackhi_ps(tx[0], tx[1]);
+        __m256 yz01 = _mm256_unpacklo_ps(tx[1], tx[2]);
+        __m256 yz23 = _mm256_unpackhi_ps(tx[1], tx[2]);
+        __m256 zx01 = _mm256_shuffle_ps(tx[2], tx[0],
+                                        _MM_SHUFFLE(1, 1, 0, 0));
+        __m256 zx23 = _mm256_shuffle_ps(tx[2], tx[0],
+                                        _MM_SHUFFLE(3, 3, 2, 2));
+        __m256 o0 = _mm256_shuffle_ps(xy01, zx01, _MM_SHUFFLE(2, 0, 1, 0));
+        __m256 o1 = _mm256_shuffle_ps(yz01, xy23, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256 o2 = _mm256_shuffle_ps(zx23, yz23, _MM_SHUFFLE(3, 2, 2, 0));
+        REAL *dst = &out[i].x;
+        _mm256_storeu_ps(dst, _mm256_permute2f128_ps(o0, o1, 0x20));
+        _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(o2, o0, 0x30));
+        _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(o1, o2, 0x31));
+    }
+
+    REAL lane[8];
+    _mm256_storeu_ps(lane, left);
+    for (int k = 0; k < 8; ++k)
+        if (lane[k] < bounds.left) bounds.left = lane[k];
+    _mm256_storeu_ps(lane, right);
+    for (int k = 0; k < 8; ++k)
+        if (lane[k] > bounds.right) bounds.right = lane[k];
+    _mm256_storeu_ps(lane, top);
+    for (int k = 0; k < 8; ++k)
+        if (lane[k] < bounds.top) bounds.top = lane[k];
+    _mm256_storeu_ps(lane, bottom);
+    for (int k = 0; k < 8; ++k)
+        if (lane[k] > bounds.bottom) bounds.bottom = lane[k];
+
+    // Avoid the penalty of mixing AVX and legacy SSE code in the caller.
+    _mm256_zeroupper();
+
+    TransformTail(t, x + simdCount, y + simdCount, z + simdCount,
+                  count - simdCount, out + simdCount, bounds);
+}
+
+#endif  // !DOUBLE_PRECISION